@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <sstream>
+
+#include "synthetic.h"
+
+namespace fasttext {
+namespace bench {
+
+namespace {
+
+const std::vector<std::string>& vocabulary() {
+  static const std::vector<std::string> vocab = makeVocabulary(50000, 1);
+  return vocab;
+}
+
+const std::string& unsupervisedCorpus() {
+  static const std::string corpus = makeCorpus(vocabulary(), 2000, 50, 0, 2);
+  return corpus;
+}
+
+const std::string& supervisedCorpus() {
+  static const std::string corpus =
+      makeCorpus(vocabulary(), 2000, 50, 100, 3);
+  return corpus;
+}
+
+// Rewinds in once all of its content has been consumed.
+void rewind(std::istream& in) {
+  in.clear();
+  in.seekg(0, std::ios_base::beg);
+}
+
+}
+
+static void BM_ReadWord(benchmark::State& state) {
+  auto dict = makeDictionary(
+      makeArgs(model_name::sg, loss_name::ns, 100), unsupervisedCorpus());
+  std::istringstream in(unsupervisedCorpus());
+  std::string word;
+  for (auto _ : state) {
+    if (!dict->readWord(in, word)) {
+      rewind(in);
+    }
+    benchmark::DoNotOptimize(word.data());
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReadWord);
+
+static void BM_GetLineSupervised(benchmark::State& state) {
+  auto dict = makeDictionary(
+      makeArgs(model_name::sup, loss_name::softmax, 100), supervisedCorpus());
+  std::istringstream in(supervisedCorpus());
+  std::vector<int32_t> words, labels;
+  int64_t ntokens = 0;
+  for (auto _ : state) {
+    if (in.peek() == EOF) {
+      rewind(in);
+    }
+    ntokens += dict->getLine(in, words, labels);
+  }
+  state.SetItemsProcessed(ntokens);
+}
+BENCHMARK(BM_GetLineSupervised);
+
+static void BM_GetLineUnsupervised(benchmark::State& state) {
+  auto dict = makeDictionary(
+      makeArgs(model_name::sg, loss_name::ns, 100), unsupervisedCorpus());
+  std::istringstream in(unsupervisedCorpus());
+  std::vector<int32_t> words;
+  std::minstd_rand rng(1);
+  int64_t ntokens = 0;
+  for (auto _ : state) {
+    if (in.peek() == EOF) {
+      rewind(in);
+    }
+    ntokens += dict->getLine(in, words, rng);
+  }
+  state.SetItemsProcessed(ntokens);
+}
+BENCHMARK(BM_GetLineUnsupervised);
+
+// Arguments: minn, maxn.
+static void BM_ComputeSubwords(benchmark::State& state) {
+  auto args = makeArgs(model_name::sg, loss_name::ns, 100);
+  args->minn = state.range(0);
+  args->maxn = state.range(1);
+  auto dict = makeDictionary(args, unsupervisedCorpus());
+  std::vector<std::string> words;
+  for (const auto& word : vocabulary()) {
+    words.push_back(Dictionary::BOW + word + Dictionary::EOW);
+  }
+  std::vector<int32_t> ngrams;
+  size_t i = 0;
+  for (auto _ : state) {
+    ngrams.clear();
+    dict->computeSubwords(words[i], ngrams);
+    benchmark::DoNotOptimize(ngrams.data());
+    i = (i + 1) % words.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ComputeSubwords)->Args({3, 6})->Args({2, 4});
+
+}
+}
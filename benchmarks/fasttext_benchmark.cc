@@ -0,0 +1,116 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <set>
+
+#include "fasttext.h"
+#include "synthetic.h"
+
+namespace fasttext {
+namespace bench {
+
+namespace {
+
+// A skipgram model trained for one epoch on a synthetic corpus.
+FastText& trainedModel() {
+  static FastText* fasttext = nullptr;
+  if (!fasttext) {
+    auto vocab = makeVocabulary(20000, 1);
+    auto path = writeTempFile(makeCorpus(vocab, 5000, 50, 0, 2));
+    Args args = *makeArgs(model_name::sg, loss_name::ns, 100);
+    args.input = path;
+    args.epoch = 1;
+    args.bucket = 200000;
+    fasttext = new FastText();
+    fasttext->train(args);
+    std::remove(path.c_str());
+  }
+  return *fasttext;
+}
+
+}
+
+static void BM_FindNN(benchmark::State& state) {
+  FastText& fasttext = trainedModel();
+  auto dict = fasttext.getDictionary();
+  int32_t dim = fasttext.getDimension();
+  Matrix wordVectors(dict->nwords(), dim);
+  fasttext.precomputeWordVectors(wordVectors);
+  Vector query(dim);
+  std::set<std::string> banSet;
+  std::vector<std::pair<real, std::string>> results;
+  int32_t i = 0;
+  for (auto _ : state) {
+    fasttext.getWordVector(query, dict->getWord(i));
+    fasttext.findNN(wordVectors, query, 10, banSet, results);
+    benchmark::DoNotOptimize(results.data());
+    i = (i + 1) % dict->nwords();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FindNN)->Unit(benchmark::kMillisecond);
+
+// Neighbours of state.range(0) words at once.
+static void BM_FindNNBatch(benchmark::State& state) {
+  FastText& fasttext = trainedModel();
+  auto dict = fasttext.getDictionary();
+  int32_t dim = fasttext.getDimension();
+  Matrix wordVectors(dict->nwords(), dim);
+  fasttext.precomputeWordVectors(wordVectors);
+  int64_t n = state.range(0);
+  std::vector<std::string> words;
+  std::vector<int32_t> exclude;
+  for (int64_t i = 0; i < n; i++) {
+    words.push_back(dict->getWord(i % dict->nwords()));
+    exclude.push_back(i % dict->nwords());
+  }
+  Matrix queries(n, dim);
+  fasttext.getWordVectors(words, queries.data(), 1);
+  std::vector<int32_t> ids(n * 10);
+  std::vector<real> scores(n * 10);
+  for (auto _ : state) {
+    fasttext.findNNBatch(
+        wordVectors, queries, 10, exclude, ids.data(), scores.data(), 1);
+    benchmark::DoNotOptimize(ids.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_FindNNBatch)->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond);
+
+static void BM_PrecomputeWordVectors(benchmark::State& state) {
+  FastText& fasttext = trainedModel();
+  auto dict = fasttext.getDictionary();
+  Matrix wordVectors(dict->nwords(), fasttext.getDimension());
+  for (auto _ : state) {
+    fasttext.precomputeWordVectors(wordVectors, state.range(0));
+    benchmark::DoNotOptimize(wordVectors.data());
+  }
+  state.SetItemsProcessed(state.iterations() * dict->nwords());
+}
+BENCHMARK(BM_PrecomputeWordVectors)->Arg(1)->Arg(4)->Unit(benchmark::kMillisecond);
+
+static void BM_GetWordVector(benchmark::State& state) {
+  FastText& fasttext = trainedModel();
+  auto dict = fasttext.getDictionary();
+  Vector vec(fasttext.getDimension());
+  int32_t i = 0;
+  for (auto _ : state) {
+    fasttext.getWordVector(vec, dict->getWord(i));
+    benchmark::DoNotOptimize(vec.data());
+    i = (i + 1) % dict->nwords();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetWordVector);
+
+}
+}
@@ -0,0 +1,90 @@
+# Copyright (c) 2017-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import argparse
+import itertools
+import random
+import string
+import sys
+
+
+def make_vocabulary(nwords, rng):
+    letters = string.ascii_lowercase
+    return [
+        "".join(rng.choice(letters) for _ in range(rng.randint(3, 12))) +
+        str(i) for i in range(nwords)
+    ]
+
+
+def zipf_cum_weights(n, exponent):
+    return list(
+        itertools.accumulate(1.0 / (r + 1) ** exponent for r in range(n))
+    )
+
+
+def generate_corpus(
+    out, ntokens, nwords, line_length, nlabels=0, exponent=1.0, seed=1
+):
+    """
+    Writes about ntokens words drawn from a Zipf distribution over a random
+    vocabulary of nwords words, line_length words per line. When nlabels is
+    positive, every line starts with a label, labels being Zipf distributed
+    as well.
+    """
+    rng = random.Random(seed)
+    vocab = make_vocabulary(nwords, rng)
+    word_weights = zipf_cum_weights(nwords, exponent)
+    labels = ["__label__" + str(i) for i in range(nlabels)]
+    label_weights = zipf_cum_weights(nlabels, exponent)
+    written = 0
+    while written < ntokens:
+        words = rng.choices(vocab, cum_weights=word_weights, k=line_length)
+        if nlabels > 0:
+            words.insert(0, rng.choices(labels, cum_weights=label_weights)[0])
+        out.write(" ".join(words) + "\n")
+        written += line_length
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description='Generates a Zipf distributed synthetic corpus.'
+    )
+    parser.add_argument('output', help='Output path, - for stdout.')
+    parser.add_argument(
+        '--tokens', type=int, default=10000000, help='Number of words.'
+    )
+    parser.add_argument(
+        '--vocab', type=int, default=100000, help='Size of the vocabulary.'
+    )
+    parser.add_argument(
+        '--line-length', type=int, default=50, help='Words per line.'
+    )
+    parser.add_argument(
+        '--labels',
+        type=int,
+        default=0,
+        help='Number of labels, 0 for an unsupervised corpus.'
+    )
+    parser.add_argument(
+        '--exponent', type=float, default=1.0, help='Zipf exponent.'
+    )
+    parser.add_argument('--seed', type=int, default=1, help='Random seed.')
+    args = parser.parse_args()
+    if args.output == "-":
+        out = sys.stdout
+    else:
+        out = open(args.output, "w")
+    generate_corpus(
+        out, args.tokens, args.vocab, args.line_length, args.labels,
+        args.exponent, args.seed
+    )
+    out.close()
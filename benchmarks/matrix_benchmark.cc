@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <map>
+#include <memory>
+
+#include "qmatrix.h"
+#include "synthetic.h"
+#include "vector.h"
+
+namespace fasttext {
+namespace bench {
+
+namespace {
+
+constexpr int64_t NROWS = 100000;
+
+// Rows are picked with a large stride so that most of them miss the cache,
+// as the rows of the input matrix do during training.
+constexpr int64_t ROW_STRIDE = 7919;
+
+const Matrix& randomRows(int64_t dim) {
+  static std::map<int64_t, std::unique_ptr<Matrix>> matrices;
+  auto& mat = matrices[dim];
+  if (!mat) {
+    mat = std::unique_ptr<Matrix>(new Matrix(NROWS, dim));
+    randomMatrix(*mat, 1);
+  }
+  return *mat;
+}
+
+// Arguments: number of rows, dim, dsub, nbits.
+const QMatrix& quantizedRows(const benchmark::State& state) {
+  static std::map<std::vector<int64_t>, std::unique_ptr<QMatrix>> matrices;
+  std::vector<int64_t> key = {
+      state.range(0), state.range(1), state.range(2), state.range(3)};
+  auto& qmat = matrices[key];
+  if (!qmat) {
+    Matrix mat(state.range(0), state.range(1));
+    randomMatrix(mat, 2);
+    qmat = std::unique_ptr<QMatrix>(
+        new QMatrix(mat, state.range(2), false, state.range(3)));
+  }
+  return *qmat;
+}
+
+}
+
+// Arguments: dim.
+static void BM_MatrixDotRow(benchmark::State& state) {
+  const Matrix& mat = randomRows(state.range(0));
+  Vector vec(state.range(0));
+  vec.zero();
+  vec[0] = 1.0;
+  int64_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(mat.dotRow(vec, i));
+    i = (i + ROW_STRIDE) % NROWS;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MatrixDotRow)->Arg(100)->Arg(300);
+
+// Arguments: dim.
+static void BM_MatrixAddRow(benchmark::State& state) {
+  Matrix mat(randomRows(state.range(0)));
+  Vector vec(state.range(0));
+  vec.zero();
+  int64_t i = 0;
+  for (auto _ : state) {
+    mat.addRow(vec, i, 1e-3);
+    i = (i + ROW_STRIDE) % NROWS;
+  }
+  benchmark::DoNotOptimize(mat.data());
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MatrixAddRow)->Arg(100)->Arg(300);
+
+// Arguments: number of rows, dim, dsub, nbits.
+static void BM_QMatrixDotRow(benchmark::State& state) {
+  const QMatrix& qmat = quantizedRows(state);
+  Vector vec(state.range(1));
+  vec.zero();
+  vec[0] = 1.0;
+  int64_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(qmat.dotRow(vec, i));
+    i = (i + ROW_STRIDE) % qmat.getM();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_QMatrixDotRow)
+    ->Args({20000, 100, 2, 8})
+    ->Args({20000, 100, 4, 4});
+
+// Scores every row at once, as the output matrix is during prediction.
+// Arguments: number of rows, dim, dsub, nbits.
+static void BM_QMatrixDotRows(benchmark::State& state) {
+  const QMatrix& qmat = quantizedRows(state);
+  Vector vec(state.range(1));
+  vec.zero();
+  vec[0] = 1.0;
+  Vector out(qmat.getM());
+  for (auto _ : state) {
+    qmat.dotRows(vec, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * qmat.getM());
+}
+BENCHMARK(BM_QMatrixDotRows)
+    ->Args({20000, 100, 2, 8})
+    ->Args({20000, 100, 4, 4});
+
+}
+}
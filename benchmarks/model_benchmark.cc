@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <random>
+
+#include "model.h"
+#include "synthetic.h"
+
+namespace fasttext {
+namespace bench {
+
+namespace {
+
+constexpr int64_t NROWS = 100000;
+constexpr int32_t NINPUTS = 1000;
+constexpr int32_t INPUT_LENGTH = 20;
+constexpr int32_t DIM = 100;
+
+struct ModelFixture {
+  std::shared_ptr<Args> args;
+  std::shared_ptr<Matrix> wi;
+  std::shared_ptr<Matrix> wo;
+  std::unique_ptr<Model> model;
+  std::vector<std::vector<int32_t>> inputs;
+  std::vector<int32_t> targets;
+
+  // A supervised model over osz labels with Zipf distributed label counts.
+  ModelFixture(loss_name loss, int32_t osz) {
+    args = makeArgs(model_name::sup, loss, DIM);
+    wi = std::make_shared<Matrix>(NROWS, DIM);
+    wi->uniform(1.0 / DIM);
+    wo = std::make_shared<Matrix>(osz, DIM);
+    randomMatrix(*wo, 1);
+    model = std::unique_ptr<Model>(new Model(wi, wo, args, 0));
+    std::vector<int64_t> counts(osz);
+    for (int32_t i = 0; i < osz; i++) {
+      counts[i] = 1000000 / (i + 1) + 1;
+    }
+    model->setTargetCounts(counts);
+
+    std::minstd_rand rng(2);
+    std::uniform_int_distribution<int32_t> row(0, NROWS - 1);
+    std::uniform_int_distribution<int32_t> label(0, osz - 1);
+    inputs.resize(NINPUTS);
+    for (auto& input : inputs) {
+      for (int32_t j = 0; j < INPUT_LENGTH; j++) {
+        input.push_back(row(rng));
+      }
+      targets.push_back(label(rng));
+    }
+  }
+};
+
+}
+
+// Arguments: loss, number of labels.
+static void BM_ModelUpdate(benchmark::State& state) {
+  ModelFixture f(static_cast<loss_name>(state.range(0)), state.range(1));
+  int32_t i = 0;
+  for (auto _ : state) {
+    f.model->update(f.inputs[i], f.targets[i], 0.05);
+    i = (i + 1) % NINPUTS;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ModelUpdate)
+    ->ArgNames({"loss", "labels"})
+    ->Args({static_cast<int>(loss_name::softmax), 100})
+    ->Args({static_cast<int>(loss_name::softmax), 1000})
+    ->Args({static_cast<int>(loss_name::hs), 1000})
+    ->Args({static_cast<int>(loss_name::hs), 100000})
+    ->Args({static_cast<int>(loss_name::ns), 1000})
+    ->Args({static_cast<int>(loss_name::ns), 100000});
+
+// Arguments: loss, number of labels, k.
+static void BM_ModelPredict(benchmark::State& state) {
+  ModelFixture f(static_cast<loss_name>(state.range(0)), state.range(1));
+  Vector hidden(DIM), output(state.range(1));
+  std::vector<std::pair<real, int32_t>> heap;
+  int32_t i = 0;
+  for (auto _ : state) {
+    heap.clear();
+    f.model->predict(f.inputs[i], state.range(2), 0.0, heap, hidden, output);
+    benchmark::DoNotOptimize(heap.data());
+    i = (i + 1) % NINPUTS;
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ModelPredict)
+    ->ArgNames({"loss", "labels", "k"})
+    ->Args({static_cast<int>(loss_name::softmax), 1000, 1})
+    ->Args({static_cast<int>(loss_name::softmax), 1000, 5})
+    ->Args({static_cast<int>(loss_name::hs), 1000, 1})
+    ->Args({static_cast<int>(loss_name::hs), 100000, 1})
+    ->Args({static_cast<int>(loss_name::ns), 1000, 1})
+    ->Args({static_cast<int>(loss_name::ns), 100000, 1});
+
+}
+}
@@ -0,0 +1,110 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "synthetic.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace fasttext {
+namespace bench {
+
+std::vector<std::string> makeVocabulary(int32_t nwords, uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::uniform_int_distribution<int> length(3, 12);
+  std::uniform_int_distribution<int> letter('a', 'z');
+  std::vector<std::string> vocab;
+  vocab.reserve(nwords);
+  for (int32_t i = 0; i < nwords; i++) {
+    std::string word(length(rng), ' ');
+    for (auto& c : word) {
+      c = letter(rng);
+    }
+    vocab.push_back(word + std::to_string(i));
+  }
+  return vocab;
+}
+
+std::string makeCorpus(
+    const std::vector<std::string>& vocab,
+    int32_t nlines,
+    int32_t nwords,
+    int32_t nlabels,
+    uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::vector<double> weights(vocab.size());
+  for (size_t i = 0; i < weights.size(); i++) {
+    weights[i] = 1.0 / (i + 1);
+  }
+  std::discrete_distribution<int32_t> zipf(weights.begin(), weights.end());
+  std::uniform_int_distribution<int32_t> label(0, std::max(nlabels - 1, 0));
+  std::ostringstream out;
+  for (int32_t i = 0; i < nlines; i++) {
+    if (nlabels > 0) {
+      out << "__label__" << label(rng) << " ";
+    }
+    for (int32_t j = 0; j < nwords; j++) {
+      out << vocab[zipf(rng)] << (j + 1 < nwords ? " " : "\n");
+    }
+  }
+  return out.str();
+}
+
+std::string writeTempFile(const std::string& content) {
+  char path[] = "/tmp/fasttext-bench-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    throw std::runtime_error("Cannot create a temporary file");
+  }
+  close(fd);
+  std::ofstream ofs(path);
+  ofs << content;
+  return path;
+}
+
+void randomMatrix(Matrix& mat, uint32_t seed) {
+  std::minstd_rand rng(seed);
+  std::uniform_real_distribution<> uniform(-1, 1);
+  for (int64_t i = 0; i < mat.size(0) * mat.size(1); i++) {
+    mat.data()[i] = uniform(rng);
+  }
+}
+
+std::shared_ptr<Args> makeArgs(model_name model, loss_name loss, int dim) {
+  auto args = std::make_shared<Args>();
+  args->model = model;
+  args->loss = loss;
+  args->dim = dim;
+  args->minCount = 1;
+  args->verbose = 0;
+  args->thread = 1;
+  if (model == model_name::sup) {
+    args->minn = 0;
+    args->maxn = 0;
+    args->wordNgrams = 2;
+  }
+  return args;
+}
+
+std::shared_ptr<Dictionary> makeDictionary(
+    std::shared_ptr<Args> args,
+    const std::string& corpus) {
+  auto dict = std::make_shared<Dictionary>(args);
+  std::istringstream in(corpus);
+  dict->readFromFile(in);
+  return dict;
+}
+
+}
+}
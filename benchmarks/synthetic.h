@@ -0,0 +1,48 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "dictionary.h"
+#include "matrix.h"
+
+namespace fasttext {
+namespace bench {
+
+// Random lowercase words of 3 to 12 characters.
+std::vector<std::string> makeVocabulary(int32_t nwords, uint32_t seed);
+
+// nlines lines of nwords words drawn from a Zipf distribution over vocab.
+// When nlabels is positive, every line starts with one label.
+std::string makeCorpus(
+    const std::vector<std::string>& vocab,
+    int32_t nlines,
+    int32_t nwords,
+    int32_t nlabels,
+    uint32_t seed);
+
+// Writes content to a new temporary file and returns its path.
+std::string writeTempFile(const std::string& content);
+
+void randomMatrix(Matrix& mat, uint32_t seed);
+
+std::shared_ptr<Args> makeArgs(model_name model, loss_name loss, int dim);
+
+std::shared_ptr<Dictionary> makeDictionary(
+    std::shared_ptr<Args> args,
+    const std::string& corpus);
+
+}
+}
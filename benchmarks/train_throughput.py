@@ -0,0 +1,180 @@
+# Copyright (c) 2017-present, Facebook, Inc.
+# All rights reserved.
+#
+# This source code is licensed under the BSD-style license found in the
+# LICENSE file in the root directory of this source tree. An additional grant
+# of patent rights can be found in the PATENTS file in the same directory.
+
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+from __future__ import unicode_literals
+
+import argparse
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from generate_corpus import generate_corpus
+
+WORDS_PER_SEC_RE = re.compile(r"words/sec/thread:\s*(\d+)")
+
+
+def run_training(fasttext, mode, corpus, output, thread, extra):
+    """
+    Trains one model and returns the last words/sec/thread rate reported by
+    fasttext, the wall time and the peak RSS of the process in bytes.
+    """
+    cmd = [
+        fasttext, mode, "-input", corpus, "-output", output, "-thread",
+        str(thread), "-verbose", "2"
+    ] + extra
+    start = time.time()
+    proc = subprocess.Popen(
+        cmd, stdout=subprocess.DEVNULL, stderr=subprocess.PIPE
+    )
+    stderr = proc.stderr.read().decode("utf-8", "replace")
+    _, status, usage = os.wait4(proc.pid, 0)
+    elapsed = time.time() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    if proc.returncode != 0:
+        raise RuntimeError(
+            "{} failed with code {}:\n{}".format(
+                " ".join(cmd), proc.returncode, stderr
+            )
+        )
+    rates = WORDS_PER_SEC_RE.findall(stderr)
+    if not rates:
+        raise RuntimeError("No throughput reported by " + " ".join(cmd))
+    # ru_maxrss is in kilobytes on Linux.
+    return int(rates[-1]), elapsed, usage.ru_maxrss * 1024
+
+
+def benchmark(args):
+    workdir = tempfile.mkdtemp(prefix="fasttext-throughput-")
+    try:
+        corpora = {}
+        for mode in args.modes:
+            labels = args.labels if mode == "supervised" else 0
+            if labels not in corpora:
+                path = os.path.join(workdir, "corpus{}.txt".format(labels))
+                with open(path, "w") as f:
+                    generate_corpus(
+                        f, args.tokens, args.vocab, args.line_length, labels,
+                        args.exponent, args.seed
+                    )
+                corpora[labels] = path
+
+        results = []
+        for mode in args.modes:
+            corpus = corpora[args.labels if mode == "supervised" else 0]
+            base = None
+            for thread in args.threads:
+                runs = [
+                    run_training(
+                        args.fasttext, mode, corpus,
+                        os.path.join(workdir, "model"), thread, args.extra
+                    ) for _ in range(args.repeat)
+                ]
+                best = max(runs, key=lambda r: r[0])
+                if base is None:
+                    base = (thread, best[0])
+                result = {
+                    "mode": mode,
+                    "threads": thread,
+                    "words_per_sec_thread": best[0],
+                    "words_per_sec": best[0] * thread,
+                    # Per-thread rate relative to the smallest thread count.
+                    "scaling_efficiency": best[0] / base[1],
+                    "seconds": min(r[1] for r in runs),
+                    "peak_rss_bytes": max(r[2] for r in runs),
+                }
+                results.append(result)
+                print(
+                    "{mode:>10} threads={threads:<3} "
+                    "words/sec/thread={words_per_sec_thread:<9} "
+                    "efficiency={scaling_efficiency:.2f} "
+                    "rss={peak_rss_bytes}".format(**result),
+                    file=sys.stderr
+                )
+        return {
+            "config": {
+                "tokens": args.tokens,
+                "vocab": args.vocab,
+                "line_length": args.line_length,
+                "labels": args.labels,
+                "exponent": args.exponent,
+                "seed": args.seed,
+                "repeat": args.repeat,
+                "extra": args.extra,
+            },
+            "results": results,
+        }
+    finally:
+        shutil.rmtree(workdir)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(
+        description='Training throughput of the fasttext binary on synthetic '
+        'corpora, for several thread counts. Extra fasttext arguments can be '
+        'given after --.'
+    )
+    parser.add_argument(
+        '--fasttext', default='./fasttext', help='Path to the binary.'
+    )
+    parser.add_argument(
+        '--modes',
+        default='supervised,skipgram,cbow',
+        help='Comma separated training modes.'
+    )
+    parser.add_argument(
+        '--threads',
+        default='1,2,4,8',
+        help='Comma separated thread counts.'
+    )
+    parser.add_argument(
+        '--tokens', type=int, default=10000000, help='Corpus size in words.'
+    )
+    parser.add_argument(
+        '--vocab', type=int, default=100000, help='Size of the vocabulary.'
+    )
+    parser.add_argument(
+        '--line-length', type=int, default=50, help='Words per line.'
+    )
+    parser.add_argument(
+        '--labels',
+        type=int,
+        default=100,
+        help='Number of labels of the supervised corpus.'
+    )
+    parser.add_argument(
+        '--exponent', type=float, default=1.0, help='Zipf exponent.'
+    )
+    parser.add_argument('--seed', type=int, default=1, help='Random seed.')
+    parser.add_argument(
+        '--repeat',
+        type=int,
+        default=1,
+        help='Runs per configuration, the best one is kept.'
+    )
+    parser.add_argument(
+        '--output', default='-', help='Where to write the JSON report.'
+    )
+    parser.add_argument('extra', nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+    args.modes = args.modes.split(",")
+    args.threads = [int(t) for t in args.threads.split(",")]
+    if args.extra and args.extra[0] == "--":
+        args.extra = args.extra[1:]
+    report = json.dumps(benchmark(args), indent=2)
+    if args.output == "-":
+        print(report)
+    else:
+        with open(args.output, "w") as f:
+            f.write(report + "\n")
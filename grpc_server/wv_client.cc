@@ -16,10 +16,14 @@
  *
  */
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <cmath>
+#include <thread>
+#include <vector>
 #include <grpc++/grpc++.h>
 
 #include "WordVector.grpc.pb.h"
@@ -118,6 +122,41 @@ class WordVectorClient {
     return std::string("");
   }
 
+  // Sends nrequests DetectLanguages and GetVectors calls in turn and
+  // returns their latencies in microseconds.
+  std::vector<double> Load(int32_t nrequests, const std::string& word1,
+                           const std::string& word2) {
+    DetectLanguagesRequest request;
+    request.add_texts("Bonjour Robert, comment vas-tu?");
+    request.add_texts("Hi Robert, how are you?");
+    WordVector::GetVectorsRequest gv_request;
+    gv_request.add_tokens(word1);
+    gv_request.add_tokens(word2);
+    gv_request.set_packed(true);
+    std::vector<double> latencies;
+    for (int32_t i = 0; i < nrequests; ++i) {
+      ClientContext context;
+      Status status;
+      auto start = std::chrono::steady_clock::now();
+      if (i % 2 == 0) {
+        DetectLanguagesReply reply;
+        status = stub_->DetectLanguages(&context, request, &reply);
+      } else {
+        WordVector::GetVectorsReply reply;
+        status = stub_->GetVectors(&context, gv_request, &reply);
+      }
+      auto end = std::chrono::steady_clock::now();
+      if (!status.ok()) {
+        std::cout << status.error_code() << ": " << status.error_message()
+                  << std::endl;
+        continue;
+      }
+      latencies.push_back(
+          std::chrono::duration<double, std::micro>(end - start).count());
+    }
+    return latencies;
+  }
+
  private:
   std::unique_ptr<WordVector::WordVector::Stub> stub_;
 };
@@ -140,9 +179,38 @@ int main(int argc, char** argv) {
     if(argc > 3)
         url = argv[3];
     else
-        url = "localhost:50052";
+        url = "localhost:50051";
     WordVectorClient wv(grpc::CreateChannel(url, grpc::InsecureChannelCredentials()));
-    std::string reply = wv.SayHello(word1,word2);
+    if(argc <= 4)
+    {
+        std::string reply = wv.SayHello(word1,word2);
+        return 0;
+    }
+
+    // Load test: <nthreads> clients sending <nrequests> calls each.
+    int32_t nrequests = std::stoi(argv[4]);
+    int32_t nthreads = argc > 5 ? std::stoi(argv[5]) : 1;
+    std::vector<std::vector<double> > latencies(nthreads);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for(int32_t t = 0; t < nthreads; ++t)
+        threads.emplace_back([&, t] {
+            WordVectorClient client(grpc::CreateChannel(url, grpc::InsecureChannelCredentials()));
+            latencies[t] = client.Load(nrequests, word1, word2);
+        });
+    for(auto& thread : threads)
+        thread.join();
+    double elapsed = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    std::vector<double> all;
+    for(const auto& l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    if(all.empty())
+        return 1;
+    std::sort(all.begin(), all.end());
+    printf("requests %zu qps %.1f p50_us %.1f p99_us %.1f\n", all.size(),
+           all.size() / elapsed, all[all.size() / 2],
+           all[std::min(all.size() - 1, all.size() * 99 / 100)]);
 
   
 
@@ -16,12 +16,24 @@
  *
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
-#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <grpc++/grpc++.h>
+#include "../src/compact_dictionary.h"
 #include "../src/fasttext.h"
 
 #include "WordVector.grpc.pb.h"
@@ -39,27 +51,26 @@ const std::string EOS = "</s>";
 const std::string BOW = "<";
 const std::string EOW = ">";
 
-struct VectorResult {
-   std::vector<float>  data;
-   float freq;
-   int32_t ndim;
-};
-
+// Read-only view of a compact vector file written by
+// CompactDictionary::writeCompact. The file is memory mapped and served in
+// place, so replicas on a host share its pages.
 class Dictionary
 {
   public:
-    Dictionary(std::string filename) {load(filename);}
-    ~Dictionary() {};
-
-    void load(std::string filename);
-    uint32_t hash(std::string& str);
-    int32_t find(const char* w, uint32_t h);
-    int32_t find(std::string& w);
-    void  computeSubwords(std::string word, std::vector<float>& r, float count);
-    void addVector(std::vector<float>& v1, std::vector<float>& v2);
-    void divVector(std::vector<float>& v, float div);
-    std::vector<float> toFloat(uint8_t* v, float min, float max);
-    VectorResult getWordInfo(std::string& word);
+    explicit Dictionary(const std::string& filename) {load(filename);}
+    ~Dictionary();
+    Dictionary(const Dictionary&) = delete;
+    Dictionary& operator=(const Dictionary&) = delete;
+
+    void load(const std::string& filename);
+    uint32_t hash(const char* str, size_t size) const;
+    uint32_t hash(const std::string& str) const;
+    int32_t find(const char* w, uint32_t h) const;
+    int32_t find(const std::string& w) const;
+    void computeSubwords(const std::string& word, float* r) const;
+    void addSubword(int32_t h, float* r) const;
+    float getWordVector(const std::string& word, std::string& scratch,
+                        float* r) const;
 
     int32_t nwords;
     int32_t nrwords;
@@ -69,82 +80,110 @@ class Dictionary
     int32_t nchars;
     uint8_t maxn;
     uint8_t minn;
-    std::vector<char> chars;
-    std::vector<char*> words;
-    std::vector<int32_t> hash2id;
-    std::vector<float> freqs;
-    std::vector<float> top_words;
-    std::vector<float> mins_maxs;
-    std::vector<uint8_t> sub_vecs;
-};
+    std::vector<const char*> words;
+    // Sections of the mapping.
+    const int32_t* hash2id = nullptr;
+    const char* chars = nullptr;
+    const float* freqs = nullptr;
+    const float* top_words = nullptr;
+    const float* mins_maxs = nullptr;
+    const uint8_t* sub_vecs = nullptr;
 
-Dictionary* dict = NULL;
-fasttext::FastText* ft = NULL;
+  private:
+    void* data_ = nullptr;
+    size_t size_ = 0;
+};
 
-VectorResult Dictionary::getWordInfo(std::string& word)
+// Writes the ndim floats of the vector of word to r and returns the word
+// frequency. Out of vocabulary words are assembled from their subwords in
+// scratch, so that a caller reusing it does not allocate.
+float Dictionary::getWordVector(const std::string& word, std::string& scratch,
+                                float* r) const
 {
-    //bool isdot = word_[0] == '.';
-    //std::string word = isdot ? word_.substr(1) : word_;
-
-    VectorResult ret;
     int32_t idx = hash2id[find(word)];
-    ret.ndim = ndim;
-    ret.freq = freqs[nrwords-1];
-    ret.data.resize(ndim, 0.0);
-    //if(!isdot && idx < nrwords)
-    if(idx != -1 && idx < nrwords && idx < nrwords+nsubs_bucket)
+    if(idx >= 0 && idx < nrwords)
     {
-        ret.freq = freqs[idx];
-        //memcpy(ret.data.data(), &(top_words[idx*2*ndim+(isdot ? 1 : 0)]), ndim*sizeof(float));
-        memcpy(ret.data.data(), &(top_words[idx*ndim]), ndim*sizeof(float));
-        // if(isdot)
-        //     computeSubwords(BOW + word + EOW, ret.data, 1.0);
+        memcpy(r, top_words + size_t(idx)*ndim, ndim*sizeof(float));
+        return freqs[idx];
     }
-    else 
-        computeSubwords(BOW + word + EOW, ret.data, 0.0);
-    return ret;
+    std::fill(r, r + ndim, 0.0f);
+    scratch.assign(BOW);
+    scratch.append(word);
+    scratch.append(EOW);
+    computeSubwords(scratch, r);
+    return freqs[nrwords-1];
 }
 
-void Dictionary::load(std::string filename)
+Dictionary::~Dictionary()
 {
-    FILE* fd = fopen (filename.c_str(), "rb");
-    fread(&nwords, sizeof(int32_t), 1, fd);
-    fread(&nrwords, sizeof(int32_t), 1, fd);
-    fread(&nwords_bucket, sizeof(int32_t), 1, fd);
-    fread(&nsubs_bucket, sizeof(int32_t), 1, fd);
-    fread(&ndim, sizeof(int32_t), 1, fd);
-    fread(&nchars, sizeof(int32_t), 1, fd);
-    fread(&minn, sizeof(uint8_t), 1, fd);
-    fread(&maxn, sizeof(uint8_t), 1, fd);
-    hash2id.resize(nwords_bucket+nsubs_bucket);
-    chars.resize(nchars);
+    if(data_ != nullptr)
+        munmap(data_, size_);
+}
+
+void Dictionary::load(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::invalid_argument(filename + " cannot be opened!");
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw std::invalid_argument(filename + " cannot be opened!");
+    }
+    size_ = st.st_size;
+    if(size_ < sizeof(fasttext::CompactHeader))
+    {
+        close(fd);
+        throw std::invalid_argument(filename + " is not a compact vector file!");
+    }
+    data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data_ == MAP_FAILED)
+    {
+        data_ = nullptr;
+        throw std::invalid_argument(filename + " cannot be mapped!");
+    }
+
+    const char* base = static_cast<const char*>(data_);
+    fasttext::CompactHeader header;
+    memcpy(&header, base, sizeof(header));
+    if(!header.isValid(size_))
+        throw std::invalid_argument(
+            filename + " is not a valid compact vector file, regenerate it "
+            "with fasttext generate-compact!");
+    nwords = header.nwords;
+    nrwords = header.nrwords;
+    nwords_bucket = header.nwords_bucket;
+    nsubs_bucket = header.nsubs_bucket;
+    ndim = header.ndim;
+    nchars = header.nchars;
+    minn = header.minn;
+    maxn = header.maxn;
+    hash2id = reinterpret_cast<const int32_t*>(base + header.hash2id);
+    chars = base + header.chars;
+    freqs = reinterpret_cast<const float*>(base + header.freqs);
+    top_words = reinterpret_cast<const float*>(base + header.top_words);
+    sub_vecs = reinterpret_cast<const uint8_t*>(base + header.sub_vecs);
+    mins_maxs = reinterpret_cast<const float*>(base + header.mins_maxs);
+
     words.resize(nrwords);
-    freqs.resize(nrwords+nsubs_bucket);
-    top_words.resize(nrwords*ndim);
-    mins_maxs.resize(nsubs_bucket*2);
-    sub_vecs.resize(nsubs_bucket*ndim/2);
-    fread(hash2id.data(), sizeof(int32_t), nwords_bucket+nsubs_bucket, fd);
-    fread(chars.data(), sizeof(char), nchars, fd);
-    
-    fread(freqs.data(), sizeof(int32_t), nrwords+nsubs_bucket, fd);
-    fread(top_words.data(), sizeof(float), nrwords*ndim, fd);
-    fread(sub_vecs.data(), sizeof(uint8_t), nsubs_bucket*ndim/2, fd);
-    fread(mins_maxs.data(), sizeof(float), nsubs_bucket*2, fd);
-    words[0] = chars.data();
-    size_t pos = 1;
-    for(size_t i = 1; i < nrwords; ++i)
+    int32_t pos = 0;
+    for(int32_t i = 0; i < nrwords; ++i)
     {
-        while(chars[pos] != '\0')
-            ++pos;
-        ++pos;
-        words[i] = &(chars[pos]);
+        words[i] = chars + pos;
+        const void* end = memchr(chars + pos, '\0', nchars - pos);
+        if(end == nullptr)
+            throw std::invalid_argument(
+                filename + " has fewer words than its header claims!");
+        pos = static_cast<const char*>(end) - chars + 1;
     }
 }
 
-uint32_t Dictionary::hash(std::string& str)  
+uint32_t Dictionary::hash(const char* str, size_t size) const
 {
     uint32_t h = 2166136261;
-    for (size_t i = 0; i < str.size(); i++) 
+    for (size_t i = 0; i < size; i++) 
     {
         h = h ^ uint32_t(str[i]);
         h = h * 16777619;
@@ -152,155 +191,456 @@ uint32_t Dictionary::hash(std::string& str)
     return h;
 }
 
-int32_t Dictionary::find(const char* w, uint32_t h) {
+uint32_t Dictionary::hash(const std::string& str) const
+{
+    return hash(str.data(), str.size());
+}
+
+int32_t Dictionary::find(const char* w, uint32_t h) const {
     int32_t id = h % nwords_bucket;
-    while (hash2id[id] != -1 && hash2id[id] < nrwords && strcmp(words[hash2id[id]], w) != 0)
+    while (hash2id[id] >= 0 && hash2id[id] < nrwords && strcmp(words[hash2id[id]], w) != 0)
         id = (id + 1) % nwords_bucket;
     return id;
 }
 
-int32_t Dictionary::find(std::string& w) 
+int32_t Dictionary::find(const std::string& w) const
 {
     return find(w.c_str(), hash(w));
 }
 
 
-void Dictionary::computeSubwords(std::string word, std::vector<float>& r, float count=0.0)
+// Adds the average of the subword vectors of word to r.
+void Dictionary::computeSubwords(const std::string& word, float* r) const
 {
+    float count = 0.0;
     for (size_t i = 0; i < word.size(); i++) 
     {
-        std::string ngram;
         if ((word[i] & 0xC0) == 0x80) continue;
         for (size_t j = i, n = 1; j < word.size() && n <= maxn; n++) {
-            ngram.push_back(word[j++]);
+            j++;
             while (j < word.size() && (word[j] & 0xC0) == 0x80) {
-                ngram.push_back(word[j++]);
+                j++;
             }
             if (n >= minn && !(n == 1 && (i == 0 || j == word.size()))) 
             {
-                int32_t h = hash2id[hash(ngram) % nsubs_bucket + nwords_bucket];
-                std::vector<float> v = toFloat(&(sub_vecs.data()[h*ndim/2]), mins_maxs[h*2], mins_maxs[h*2+1]);
-                addVector(r, v);
-                count += 1;                
+                uint32_t h = hash(word.data() + i, j - i);
+                int32_t id = hash2id[h % nsubs_bucket + nwords_bucket];
+                if(id < 0 || id >= nsubs_bucket)
+                    continue;
+                addSubword(id, r);
+                count += 1;
             }
         }
     }
-    divVector(r,count);
+    if(count > 0)
+        for(int32_t i = 0; i < ndim; ++i)
+            r[i] /= count;
 }
 
-void Dictionary::addVector(std::vector<float>& v1, std::vector<float>& v2)
+// Dequantizes the 4-bit vector of subword h and adds it to r.
+void Dictionary::addSubword(int32_t h, float* r) const
 {
-    for(size_t i = 0; i < ndim; ++i)
-        v1[i] += v2[i];
+    const uint8_t* v = sub_vecs + size_t(h)*ndim/2;
+    float min = mins_maxs[h*2];
+    float step = (mins_maxs[h*2+1]-min)/15.0;
+    for(int32_t i = 0; i < ndim/2; ++i)
+    {
+        r[2*i] += (v[i]%16)*step+min;
+        r[2*i+1] += (v[i]/16)*step+min;
+    }
 }
 
-void Dictionary::divVector(std::vector<float>& v, float div)
+// Server settings, see main for the corresponding command line flags.
+struct ServerOptions
 {
-    for(size_t i = 0; i < ndim; ++i)
-        v[i] /= div;
-}
+    std::string url = "localhost:50051";
+    int32_t workers = 4;
+    int32_t maxBatch = 64;
+    int32_t batchDelay = 0;     // microseconds
+    int32_t statsInterval = 10; // seconds, 0 disables the report
+};
+
+class Worker;
+
+// A pending RPC. Calls are created by the completion queue thread when a
+// request arrives, queued for the workers and answered by them; the
+// completion queue thread deletes them once the reply is sent.
+class Call
+{
+  public:
+    virtual ~Call() {}
+    // Called from the completion queue thread when the event tagged with
+    // this call completes.
+    virtual void proceed(bool ok) = 0;
+    // Computes the reply and sends it; called from a worker thread.
+    virtual void process(Worker& worker) = 0;
+};
 
-std::vector<float> Dictionary::toFloat(uint8_t* v, float min, float max)
+// Pending calls waiting for a worker. Workers take them out in batches of
+// up to maxBatch calls, waiting at most batchDelay for a batch to fill up
+// once the first call is there. With no delay, a batch is whatever queued
+// up while the workers were busy.
+class BatchQueue
 {
-    float step = (max-min)/15.0;
-    std::vector<float> r(ndim);
-    for(size_t i = 0; i < ndim/2; ++i)
+  public:
+    BatchQueue(int32_t maxBatch, int32_t batchDelay)
+        : maxBatch_(maxBatch), batchDelay_(batchDelay), maxDepth_(0),
+          requests_(0), batches_(0), shutdown_(false) {}
+
+    void push(Call* call)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            calls_.push_back(call);
+            maxDepth_ = std::max(maxDepth_, calls_.size());
+        }
+        cv_.notify_one();
+    }
+
+    // Moves the next batch into batch. Returns false when shutting down.
+    bool pop(std::vector<Call*>& batch)
     {
-        r[2*i] = (v[i]%16)*step+min;
-        r[2*i+1] = (v[i]/16)*step+min;
+        batch.clear();
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] { return shutdown_ || !calls_.empty(); });
+        if(shutdown_)
+            return false;
+        auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds(batchDelay_);
+        while(calls_.size() < maxBatch_ && !shutdown_ &&
+              cv_.wait_until(lock, deadline) != std::cv_status::timeout);
+        size_t n = std::min(calls_.size(), size_t(maxBatch_));
+        batch.assign(calls_.begin(), calls_.begin() + n);
+        calls_.erase(calls_.begin(), calls_.begin() + n);
+        requests_ += n;
+        batches_++;
+        return true;
     }
-    return r;
-}
 
-class WordVectorImpl final : public WordVector::WordVector::Service {
-    Status DetectLanguages(ServerContext* context, const DetectLanguagesRequest* request, 
-                          DetectLanguagesReply* response) override 
+    void shutdown()
     {
-        int32_t ntexts = request->texts_size();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        cv_.notify_all();
+    }
+
+    // Writes the queue depth and batching counters accumulated since the
+    // previous report, then resets them.
+    void report(std::ostream& out)
+    {
+        size_t depth, maxDepth;
+        int64_t requests, batches;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            depth = calls_.size();
+            maxDepth = maxDepth_;
+            requests = requests_;
+            batches = batches_;
+            maxDepth_ = depth;
+            requests_ = 0;
+            batches_ = 0;
+        }
+        out << "queue_depth " << depth << " max_queue_depth " << maxDepth
+            << " requests " << requests << " batches " << batches
+            << " mean_batch "
+            << (batches > 0 ? double(requests) / batches : 0.0) << std::endl;
+    }
+
+  private:
+    const size_t maxBatch_;
+    const int32_t batchDelay_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Call*> calls_;
+    size_t maxDepth_;
+    int64_t requests_;
+    int64_t batches_;
+    bool shutdown_;
+};
+
+// Models shared by all the workers. Both are only read once loaded.
+struct Models
+{
+    std::unique_ptr<Dictionary> dict;
+    std::unique_ptr<fasttext::FastText> ft;
+};
+
+// A worker thread with its own inference scratch.
+class Worker
+{
+  public:
+    Worker(const Models& models, BatchQueue& queue)
+        : models(models), queue_(queue)
+    {
+        if(models.ft)
+            ctx.reset(new fasttext::PredictContext(*models.ft));
+    }
+
+    void run()
+    {
+        std::vector<Call*> batch;
+        while(queue_.pop(batch))
+        {
+            for(Call* call : batch)
+                call->process(*this);
+        }
+    }
+
+    const Models& models;
+    std::unique_ptr<fasttext::PredictContext> ctx;
+    std::vector<std::pair<float,std::string> > predictions;
+    std::string token;
+
+  private:
+    BatchQueue& queue_;
+};
+
+class DetectLanguagesCall : public Call
+{
+  public:
+    DetectLanguagesCall(WordVector::WordVector::AsyncService& service,
+                        grpc::ServerCompletionQueue& cq, BatchQueue& queue)
+        : service_(service), cq_(cq), queue_(queue), responder_(&context_),
+          finished_(false)
+    {
+        service_.RequestDetectLanguages(&context_, &request_, &responder_,
+                                        &cq_, &cq_, this);
+    }
+
+    void proceed(bool ok) override
+    {
+        if(!finished_ && ok)
+        {
+            new DetectLanguagesCall(service_, cq_, queue_);
+            queue_.push(this);
+        }
+        else
+            delete this;
+    }
+
+    void process(Worker& worker) override
+    {
+        const fasttext::FastText* ft = worker.models.ft.get();
+        int32_t ntexts = request_.texts_size();
         for(int32_t i = 0; i < ntexts; ++i)
         {
-            std::vector<std::pair<float,std::string> > predictions(1);
-            std::string s = ""+request->texts(i);
-            std::stringstream ss(s);
-            WordVector::DetectedLanguage* value = response->add_results();
+            const std::string& text = request_.texts(i);
+            WordVector::DetectedLanguage* value = reply_.add_results();
+            value->set_language("unk");
             if(ft != NULL)
             {
-                ft->predict(ss, 1, predictions, 0.0);
-                if(predictions.size() > 0)
-                    if(predictions[0].second.substr(0,9) == "__label__")
-                        value->set_language(predictions[0].second.substr(9));
+                ft->predict(text.data(), text.size(), 1, worker.predictions,
+                            *worker.ctx, 0.0);
+                if(worker.predictions.size() > 0)
+                {
+                    const std::string& label = worker.predictions[0].second;
+                    if(label.compare(0, 9, "__label__") == 0)
+                        value->set_language(label.substr(9));
                     else
-                        value->set_language(predictions[0].second);
-                else
-                    value->set_language("unk");
+                        value->set_language(label);
+                }
             }
-            else
-                value->set_language("unk");
-            value->set_text(request->texts(i));
+            value->set_text(text);
+        }
+        finished_ = true;
+        responder_.Finish(reply_, Status::OK, this);
+    }
+
+  private:
+    WordVector::WordVector::AsyncService& service_;
+    grpc::ServerCompletionQueue& cq_;
+    BatchQueue& queue_;
+    ServerContext context_;
+    DetectLanguagesRequest request_;
+    DetectLanguagesReply reply_;
+    grpc::ServerAsyncResponseWriter<DetectLanguagesReply> responder_;
+    bool finished_;
+};
+
+class GetVectorsCall : public Call
+{
+  public:
+    GetVectorsCall(WordVector::WordVector::AsyncService& service,
+                   grpc::ServerCompletionQueue& cq, BatchQueue& queue)
+        : service_(service), cq_(cq), queue_(queue), responder_(&context_),
+          finished_(false)
+    {
+        service_.RequestGetVectors(&context_, &request_, &responder_,
+                                   &cq_, &cq_, this);
+    }
+
+    void proceed(bool ok) override
+    {
+        if(!finished_ && ok)
+        {
+            new GetVectorsCall(service_, cq_, queue_);
+            queue_.push(this);
         }
-        
-        return Status::OK;
+        else
+            delete this;
     }
-    
-    Status GetVectors(ServerContext* context, const GetVectorsRequest* request, 
-                          GetVectorsReply* response) override 
+
+    void process(Worker& worker) override
     {
-        int32_t ntokens = request->tokens_size();
-        //std::vector<float> temp(300,12.23);
-        
-        for(size_t i = 0; i < ntokens; ++i)
+        // The vectors are written straight into the reply buffers.
+        const Dictionary* dict = worker.models.dict.get();
+        int32_t ntokens = request_.tokens_size();
+        int32_t ndim = dict->ndim;
+        if(request_.packed())
+        {
+            reply_.set_dim(ndim);
+            reply_.mutable_data()->Resize(ntokens*ndim, 0.0f);
+            reply_.mutable_frequencies()->Resize(ntokens, 0.0f);
+            float* data = reply_.mutable_data()->mutable_data();
+            float* freqs = reply_.mutable_frequencies()->mutable_data();
+            for(int32_t i = 0; i < ntokens; ++i)
+                freqs[i] = dict->getWordVector(
+                    request_.tokens(i), worker.token, data + i*ndim);
+        }
+        else
         {
-            std::string token = request->tokens(i);
-            VectorResult result = dict->getWordInfo(token);
-            printf("%s %f %d\n", token.c_str(), result.freq, result.ndim);
-            WordVector::Vector* vec = response->add_vectors();
-            vec->set_frequency(result.freq);                
-            vec->set_data(result.data.data(), result.ndim*sizeof(float));
+            reply_.mutable_vectors()->Reserve(ntokens);
+            for(int32_t i = 0; i < ntokens; ++i)
+            {
+                WordVector::Vector* vec = reply_.add_vectors();
+                std::string* bytes = vec->mutable_data();
+                bytes->resize(ndim*sizeof(float));
+                vec->set_frequency(dict->getWordVector(
+                    request_.tokens(i), worker.token,
+                    reinterpret_cast<float*>(&(*bytes)[0])));
+            }
         }
-        
-        return Status::OK;
+        finished_ = true;
+        responder_.Finish(reply_, Status::OK, this);
     }
+
+  private:
+    WordVector::WordVector::AsyncService& service_;
+    grpc::ServerCompletionQueue& cq_;
+    BatchQueue& queue_;
+    ServerContext context_;
+    GetVectorsRequest request_;
+    GetVectorsReply reply_;
+    grpc::ServerAsyncResponseWriter<GetVectorsReply> responder_;
+    bool finished_;
 };
 
-void RunServer(std::string url ) {
-    
-    std::string server_address(url.c_str());
-    WordVectorImpl service;
+void RunServer(const Models& models, const ServerOptions& options)
+{
+    WordVector::WordVector::AsyncService service;
 
     ServerBuilder builder;
     // Listen on the given address without any authentication mechanism.
-    builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
-    // Register "service" as the instance through which we'll communicate with
-    // clients. In this case it corresponds to an *synchronous* service.
+    builder.AddListeningPort(options.url, grpc::InsecureServerCredentials());
+    // Requests are received on the completion queue and answered by the
+    // worker threads.
     builder.RegisterService(&service);
-    // Finally assemble the server.
+    std::unique_ptr<grpc::ServerCompletionQueue> cq =
+        builder.AddCompletionQueue();
     std::unique_ptr<Server> server(builder.BuildAndStart());
-    std::cout << "Server listening on " << server_address << std::endl;
+    std::cout << "Server listening on " << options.url << " with "
+              << options.workers << " workers" << std::endl;
+
+    BatchQueue queue(options.maxBatch, options.batchDelay);
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<std::thread> threads;
+    for(int32_t i = 0; i < options.workers; ++i)
+    {
+        workers.emplace_back(new Worker(models, queue));
+        threads.emplace_back(&Worker::run, workers.back().get());
+    }
+    // The report is written by its own thread so that logging never blocks
+    // the request path.
+    std::atomic<bool> running(true);
+    std::thread reporter;
+    if(options.statsInterval > 0)
+    {
+        reporter = std::thread([&queue, &options, &running] {
+            while(running)
+            {
+                std::this_thread::sleep_for(
+                    std::chrono::seconds(options.statsInterval));
+                queue.report(std::cerr);
+            }
+        });
+    }
+
+    new DetectLanguagesCall(service, *cq, queue);
+    new GetVectorsCall(service, *cq, queue);
+    void* tag;
+    bool ok;
+    while(cq->Next(&tag, &ok))
+        static_cast<Call*>(tag)->proceed(ok);
 
-    // Wait for the server to shutdown. Note that some other thread must be
-    // responsible for shutting down the server for this call to ever return.
-    server->Wait();
+    queue.shutdown();
+    for(auto& thread : threads)
+        thread.join();
+    running = false;
+    if(reporter.joinable())
+        reporter.join();
 }
 
-int main(int argc, char** argv) 
+// usage: wv_server [<vectors> [<url> [<lang model>]]] [-workers <n>]
+//                  [-maxBatch <n>] [-batchDelay <us>] [-statsInterval <s>]
+int main(int argc, char** argv)
 {
     std::string path = "wiki_data_en.bin";
-    std::string url = "localhost:50051";
     std::string lang_model_path = "";
-    if(argc > 1)
-        path = argv[1];
-    if(argc > 2)
-        url = argv[2];
-    if(argc > 3)
-        lang_model_path = argv[3];
-        
-    dict = new Dictionary(path);
-    if(lang_model_path != "") 
+    ServerOptions options;
+    std::vector<std::string> positional;
+    for(int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if(arg[0] != '-')
+        {
+            positional.push_back(arg);
+            continue;
+        }
+        if(i + 1 >= argc)
+        {
+            std::cerr << arg << " is missing a value" << std::endl;
+            return 1;
+        }
+        int32_t value = std::stoi(argv[++i]);
+        if(arg == "-workers")
+            options.workers = std::max(value, 1);
+        else if(arg == "-maxBatch")
+            options.maxBatch = std::max(value, 1);
+        else if(arg == "-batchDelay")
+            options.batchDelay = std::max(value, 0);
+        else if(arg == "-statsInterval")
+            options.statsInterval = std::max(value, 0);
+        else
+        {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if(positional.size() > 0)
+        path = positional[0];
+    if(positional.size() > 1)
+        options.url = positional[1];
+    if(positional.size() > 2)
+        lang_model_path = positional[2];
+
+    Models models;
+    try
+    {
+        models.dict.reset(new Dictionary(path));
+        if(lang_model_path != "")
+        {
+            models.ft.reset(new fasttext::FastText());
+            models.ft->loadModel(lang_model_path);
+        }
+    }
+    catch(const std::invalid_argument& e)
     {
-        ft = new fasttext::FastText();
-        ft->loadModel(lang_model_path);
+        std::cerr << e.what() << std::endl;
+        return 1;
     }
-    RunServer(url);
+    RunServer(models, options);
 
   return 0;
 }
@@ -40,11 +40,43 @@ def get_word_vector(data, model):
             sys.stderr.flush()
     t4 = time.time()
     print("\nVectoring: " + str(t4 - t3))
+    return f, tokens
+
+
+def get_word_vectors(f, tokens, thread):
+    t1 = time.time()
+    vecs = f.get_word_vectors(tokens, thread)
+    t2 = time.time()
+    print("Batch vectoring (" + str(thread) + " threads): " + str(t2 - t1))
+
+
+def get_sentence_vectors(data, f, thread):
+    with open(data, 'r') as fin:
+        lines = [line.rstrip('\n') for line in fin]
+    t1 = time.time()
+    for line in lines:
+        vec = f.get_sentence_vector(line)
+    t2 = time.time()
+    print("Sentence vectoring: " + str(t2 - t1))
+    vecs = f.get_sentence_vectors(lines, thread)
+    t3 = time.time()
+    print(
+        "Batch sentence vectoring (" + str(thread) + " threads): " +
+        str(t3 - t2)
+    )
 
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser(description='Simple benchmark for get_word_vector.')
     parser.add_argument('model', help='A model file to use for benchmarking.')
     parser.add_argument('data', help='A data file to use for benchmarking.')
+    parser.add_argument(
+        '--thread',
+        type=int,
+        default=1,
+        help='Number of threads for get_word_vectors.'
+    )
     args = parser.parse_args()
-    get_word_vector(args.data, args.model)
+    f, tokens = get_word_vector(args.data, args.model)
+    get_word_vectors(f, tokens, args.thread)
+    get_sentence_vectors(args.data, f, args.thread)
@@ -31,10 +31,10 @@ class _FastText():
     strings are then encoded as UTF-8 and fed to the fastText C++ API.
     """
 
-    def __init__(self, model=None):
+    def __init__(self, model=None, output=True, max_words=-1):
         self.f = fasttext.fasttext()
         if model is not None:
-            self.f.loadModel(model)
+            self.f.loadModel(model, output, max_words)
 
     def is_quantized(self):
         return self.f.isQuant()
@@ -68,6 +68,42 @@ class _FastText():
         self.f.getSentenceVector(b, text)
         return np.array(b)
 
+    def get_word_vectors(self, words, thread=1):
+        """
+        Given a list of words, get their vector representations as the
+        rows of a single len(words) x dim array. The vectors are computed
+        by thread threads with the GIL released.
+        """
+        return self.f.getWordVectors(words, thread)
+
+    def get_sentence_vectors(self, lines, thread=1):
+        """
+        Given a list of strings, get one vector per string, as returned
+        by get_sentence_vector, as the rows of a single len(lines) x dim
+        array. The vectors are computed by thread threads with the GIL
+        released.
+        """
+
+        def check(entry):
+            if entry.find('\n') != -1:
+                raise ValueError(
+                    "predict processes one line at a time (remove \'\\n\')"
+                )
+            entry += "\n"
+            return entry
+
+        lines = [check(entry) for entry in lines]
+        return self.f.getSentenceVectors(lines, thread)
+
+    def precompute_word_vectors(self, n=-1, thread=1):
+        """
+        Store the vectors of the n most frequent words (all words by
+        default) so that get_word_vector and get_word_vectors copy them
+        instead of summing their subwords. n=0 drops the stored vectors.
+        They are kept by save_model and loaded back by load_model.
+        """
+        self.f.precomputeWordVectorTable(n, thread)
+
     def get_word_id(self, word):
         """
         Given a word, get the word id within the dictionary.
@@ -138,23 +174,51 @@ class _FastText():
             probs, labels = zip(*pairs)
             return labels, np.array(probs, copy=False)
 
+    def predict_batch(self, lines, k=1, threshold=0.0, thread=None):
+        """
+        Given a list of strings, predict the k most probable labels of
+        each of them. The lines are spread over thread threads (the
+        number of threads of the model by default) and the GIL is
+        released meanwhile.
+
+        Returns two arrays with one row per line and k columns: the ids
+        of the predicted labels, which index the list returned by
+        get_labels, and their probabilities. When fewer than k labels
+        pass the threshold, the remaining slots hold -1 and 0.
+        """
+        if not thread:
+            thread = self.f.getArgs().thread
+
+        def check(entry):
+            if entry.find('\n') != -1:
+                raise ValueError(
+                    "predict processes one line at a time (remove \'\\n\')"
+                )
+            entry += "\n"
+            return entry
+
+        lines = [check(entry) for entry in lines]
+        return self.f.batchPredict(lines, k, threshold, thread)
+
     def get_input_matrix(self):
         """
-        Get a copy of the full input matrix of a Model. This only
-        works if the model is not quantized.
+        Get a read-only view of the full input matrix of a Model, sharing
+        its memory. Use np.array on the result for a writable copy. This
+        only works if the model is not quantized.
         """
         if self.f.isQuant():
             raise ValueError("Can't get quantized Matrix")
-        return np.array(self.f.getInputMatrix())
+        return self.f.getInputMatrix()
 
     def get_output_matrix(self):
         """
-        Get a copy of the full output matrix of a Model. This only
-        works if the model is not quantized.
+        Get a read-only view of the full output matrix of a Model, sharing
+        its memory. Use np.array on the result for a writable copy. This
+        only works if the model is not quantized.
         """
         if self.f.isQuant():
             raise ValueError("Can't get quantized Matrix")
-        return np.array(self.f.getOutputMatrix())
+        return self.f.getOutputMatrix()
 
     def get_words(self, include_freq=False):
         """
@@ -227,7 +291,9 @@ class _FastText():
         thread=None,
         verbose=None,
         dsub=2,
-        qnorm=False
+        qnorm=False,
+        nbits=8,
+        opq=False
     ):
         """
         Quantize the model reducing the size of the model and
@@ -248,7 +314,7 @@ class _FastText():
             input = ""
         self.f.quantize(
             input, qout, cutoff, retrain, epoch, lr, thread, verbose, dsub,
-            qnorm
+            qnorm, nbits, opq
         )
 
 
@@ -299,9 +365,15 @@ def tokenize(text):
     return f.tokenize(text)
 
 
-def load_model(path):
-    """Load a model given a filepath and return a model object."""
-    return _FastText(path)
+def load_model(path, output=True, max_words=-1):
+    """
+    Load a model given a filepath and return a model object.
+
+    Models used only for word and sentence vectors can leave out the output
+    matrix with output=False, and keep only the max_words most frequent
+    words. Such models cannot predict or be saved.
+    """
+    return _FastText(path, output, max_words)
 
 
 def train_supervised(
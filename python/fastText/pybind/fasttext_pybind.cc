@@ -10,6 +10,7 @@
 #include <args.h>
 #include <fasttext.h>
 #include <matrix.h>
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 #include <real.h>
@@ -46,6 +47,24 @@ std::pair<std::vector<std::string>, std::vector<std::string>> getLineText(
 
 namespace py = pybind11;
 
+// Wraps the matrix in a read-only NumPy array sharing its memory. The base
+// of the array holds a reference to the matrix, which keeps it alive for as
+// long as the array or any view of it exists.
+py::array_t<fasttext::real> matrixView(
+    std::shared_ptr<const fasttext::Matrix> matrix) {
+  auto owner = new std::shared_ptr<const fasttext::Matrix>(matrix);
+  py::capsule base(owner, [](void* p) {
+    delete static_cast<std::shared_ptr<const fasttext::Matrix>*>(p);
+  });
+  std::vector<ssize_t> shape = {matrix->size(0), matrix->size(1)};
+  std::vector<ssize_t> strides = {
+      ssize_t(sizeof(fasttext::real) * matrix->size(1)),
+      ssize_t(sizeof(fasttext::real))};
+  py::array_t<fasttext::real> array(shape, strides, matrix->data(), base);
+  array.attr("setflags")(py::arg("write") = false);
+  return array;
+}
+
 PYBIND11_MODULE(fasttext_pybind, m) {
   py::class_<fasttext::Args>(m, "args")
       .def(py::init<>())
@@ -71,12 +90,15 @@ PYBIND11_MODULE(fasttext_pybind, m) {
       .def_readwrite("verbose", &fasttext::Args::verbose)
       .def_readwrite("pretrainedVectors", &fasttext::Args::pretrainedVectors)
       .def_readwrite("saveOutput", &fasttext::Args::saveOutput)
+      .def_readwrite("saveSubwords", &fasttext::Args::saveSubwords)
 
       .def_readwrite("qout", &fasttext::Args::qout)
       .def_readwrite("retrain", &fasttext::Args::retrain)
       .def_readwrite("qnorm", &fasttext::Args::qnorm)
       .def_readwrite("cutoff", &fasttext::Args::cutoff)
-      .def_readwrite("dsub", &fasttext::Args::dsub);
+      .def_readwrite("dsub", &fasttext::Args::dsub)
+      .def_readwrite("nbits", &fasttext::Args::nbits)
+      .def_readwrite("opq", &fasttext::Args::opq);
 
   py::enum_<fasttext::model_name>(m, "model_name")
       .value("cbow", fasttext::model_name::cbow)
@@ -128,18 +150,27 @@ PYBIND11_MODULE(fasttext_pybind, m) {
       .def(
           "getInputMatrix",
           [](fasttext::FastText& m) {
-            std::shared_ptr<const fasttext::Matrix> mm = m.getInputMatrix();
-            return *mm.get();
+            return matrixView(m.getInputMatrix());
           })
       .def(
           "getOutputMatrix",
           [](fasttext::FastText& m) {
-            std::shared_ptr<const fasttext::Matrix> mm = m.getOutputMatrix();
-            return *mm.get();
+            return matrixView(m.getOutputMatrix());
           })
       .def(
           "loadModel",
           [](fasttext::FastText& m, std::string s) { m.loadModel(s); })
+      .def(
+          "loadModel",
+          [](fasttext::FastText& m,
+             std::string s,
+             bool output,
+             int32_t maxWords) {
+            fasttext::LoadOptions options;
+            options.output = output;
+            options.maxWords = maxWords;
+            m.loadModel(s, options);
+          })
       .def(
           "saveModel",
           [](fasttext::FastText& m, std::string s) { m.saveModel(s); })
@@ -159,8 +190,21 @@ PYBIND11_MODULE(fasttext_pybind, m) {
           [](fasttext::FastText& m,
              fasttext::Vector& v,
              const std::string text) {
-            std::stringstream ioss(text);
-            m.getSentenceVector(ioss, v);
+            m.getSentenceVector(text.data(), text.size(), v);
+          })
+      .def(
+          "getSentenceVectors",
+          [](fasttext::FastText& m,
+             const std::vector<std::string>& lines,
+             int32_t nthreads) {
+            py::array_t<fasttext::real> vectors(
+                {ssize_t(lines.size()), ssize_t(m.getArgs().dim)});
+            fasttext::real* data = vectors.mutable_data();
+            {
+              py::gil_scoped_release release;
+              m.getSentenceVectors(lines, data, nthreads);
+            }
+            return vectors;
           })
       .def(
           "tokenize",
@@ -235,7 +279,9 @@ PYBIND11_MODULE(fasttext_pybind, m) {
              int thread,
              int verbose,
              int32_t dsub,
-             bool qnorm) {
+             bool qnorm,
+             int nbits,
+             bool opq) {
             fasttext::Args qa = fasttext::Args();
             qa.input = input;
             qa.qout = qout;
@@ -247,6 +293,8 @@ PYBIND11_MODULE(fasttext_pybind, m) {
             qa.verbose = verbose;
             qa.dsub = dsub;
             qa.qnorm = qnorm;
+            qa.nbits = nbits;
+            qa.opq = opq;
             m.quantize(qa);
           })
       .def(
@@ -258,8 +306,9 @@ PYBIND11_MODULE(fasttext_pybind, m) {
              int32_t k,
              fasttext::real threshold) {
             std::vector<std::pair<fasttext::real, std::string>> predictions;
-            std::stringstream ioss(text);
-            m.predict(ioss, k, predictions, threshold);
+            fasttext::PredictContext ctx(m);
+            m.predict(
+                text.data(), text.size(), k, predictions, ctx, threshold);
             for (auto& pair : predictions) {
               pair.first = std::exp(pair.first);
             }
@@ -278,10 +327,10 @@ PYBIND11_MODULE(fasttext_pybind, m) {
                 std::vector<std::vector<std::string>>>
                 all_predictions;
             std::vector<std::pair<fasttext::real, std::string>> predictions;
+            fasttext::PredictContext ctx(m);
             for (const std::string& text : lines) {
-              std::stringstream ioss(text);
-              predictions.clear();
-              m.predict(ioss, k, predictions, threshold);
+              m.predict(
+                  text.data(), text.size(), k, predictions, ctx, threshold);
               all_predictions.first.push_back(std::vector<fasttext::real>());
               all_predictions.second.push_back(std::vector<std::string>());
               for (auto& pair : predictions) {
@@ -294,6 +343,30 @@ PYBIND11_MODULE(fasttext_pybind, m) {
             }
             return all_predictions;
           })
+      .def(
+          "batchPredict",
+          // NOTE: lines need to end in a newline
+          // to exactly mimic the behavior of the cli
+          [](fasttext::FastText& m,
+             const std::vector<std::string>& lines,
+             int32_t k,
+             fasttext::real threshold,
+             int32_t nthreads) {
+            if (k <= 0) {
+              throw std::invalid_argument("k needs to be 1 or higher!");
+            }
+            std::vector<ssize_t> shape = {ssize_t(lines.size()), k};
+            py::array_t<int32_t> labels(shape);
+            py::array_t<fasttext::real> probs(shape);
+            int32_t* labelsData = labels.mutable_data();
+            fasttext::real* probsData = probs.mutable_data();
+            {
+              py::gil_scoped_release release;
+              m.predictBatch(
+                  lines, k, threshold, labelsData, probsData, nthreads);
+            }
+            return std::make_pair(labels, probs);
+          })
       .def("isQuant", [](fasttext::FastText& m) { return m.isQuant(); })
       .def(
           "getWordId",
@@ -310,6 +383,29 @@ PYBIND11_MODULE(fasttext_pybind, m) {
           [](fasttext::FastText& m, fasttext::Vector& vec, int32_t ind) {
             m.getInputVector(vec, ind);
           })
+      .def(
+          "getWordVectors",
+          [](fasttext::FastText& m,
+             const std::vector<std::string>& words,
+             int32_t nthreads) {
+            py::array_t<fasttext::real> vectors(
+                {ssize_t(words.size()), ssize_t(m.getArgs().dim)});
+            fasttext::real* data = vectors.mutable_data();
+            {
+              py::gil_scoped_release release;
+              m.getWordVectors(words, data, nthreads);
+            }
+            return vectors;
+          })
+      .def(
+          "precomputeWordVectorTable",
+          [](fasttext::FastText& m, int32_t n, int32_t nthreads) {
+            py::gil_scoped_release release;
+            m.precomputeWordVectorTable(n, nthreads);
+          })
+      .def(
+          "getWordVectorTableSize",
+          [](fasttext::FastText& m) { return m.getWordVectorTableSize(); })
       .def(
           "getWordVector",
           [](fasttext::FastText& m,
@@ -325,5 +421,29 @@ PYBIND11_MODULE(fasttext_pybind, m) {
             return std::pair<std::vector<std::string>, std::vector<int32_t>>(
                 subwords, ngrams);
           })
+      .def(
+          "batchPredict",
+          // NOTE: lines need to end in a newline
+          // to exactly mimic the behavior of the cli
+          [](fasttext::FastText& m,
+             const std::vector<std::string>& lines,
+             int32_t k,
+             fasttext::real threshold,
+             int32_t nthreads) {
+            if (k <= 0) {
+              throw std::invalid_argument("k needs to be 1 or higher!");
+            }
+            std::vector<ssize_t> shape = {ssize_t(lines.size()), k};
+            py::array_t<int32_t> labels(shape);
+            py::array_t<fasttext::real> probs(shape);
+            int32_t* labelsData = labels.mutable_data();
+            fasttext::real* probsData = probs.mutable_data();
+            {
+              py::gil_scoped_release release;
+              m.predictBatch(
+                  lines, k, threshold, labelsData, probsData, nthreads);
+            }
+            return std::make_pair(labels, probs);
+          })
       .def("isQuant", [](fasttext::FastText& m) { return m.isQuant(); });
 }
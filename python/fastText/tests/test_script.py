@@ -431,6 +431,84 @@ class TestFastTextUnitPy(unittest.TestCase):
         f.quantize()
         self.assertTrue(f.is_quantized())
 
+    def gen_test_supervised_matrix_view(self, kwargs):
+        f = build_supervised_model(
+            get_random_data(1000, max_vocab_size=1000), kwargs
+        )
+        input_matrix = f.get_input_matrix()
+        output_matrix = f.get_output_matrix()
+        self.assertFalse(input_matrix.flags.writeable)
+        self.assertFalse(output_matrix.flags.writeable)
+        self.assertEqual(input_matrix.shape[1], f.get_dimension())
+        # Views share the memory of the model
+        self.assertTrue(
+            np.shares_memory(input_matrix, f.get_input_matrix())
+        )
+        # and stay valid once the model has dropped its matrices.
+        copy = np.array(input_matrix)
+        f.quantize(cutoff=100)
+        self.assertTrue(np.array_equal(input_matrix, copy))
+        del f
+        self.assertTrue(np.array_equal(input_matrix, copy))
+
+    def gen_test_supervised_predict_batch(self, kwargs):
+        f = build_supervised_model(get_random_data(100), kwargs)
+        sentences = [" ".join(get_random_words(20)) for _ in range(10)]
+        labels, probs = f.predict_batch(sentences, k=3, thread=2)
+        self.assertEqual(labels.shape, (len(sentences), 3))
+        self.assertEqual(probs.shape, (len(sentences), 3))
+        all_labels = f.get_labels()
+        for i, sentence in enumerate(sentences):
+            words, word_probs = f.predict(sentence, k=3)
+            self.assertEqual(len(words), len([l for l in labels[i] if l >= 0]))
+            for j in range(len(words)):
+                self.assertEqual(all_labels[labels[i][j]], words[j])
+                self.assertAlmostEqual(probs[i][j], word_probs[j], places=5)
+
+    def gen_test_get_word_vectors(self, kwargs):
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = get_random_words(100) + f.get_words()
+        vectors = f.get_word_vectors(words, thread=2)
+        self.assertEqual(vectors.shape, (len(words), f.get_dimension()))
+        for word, vector in zip(words, vectors):
+            self.assertTrue(np.allclose(vector, f.get_word_vector(word)))
+
+    def gen_test_precompute_word_vectors(self, kwargs):
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = get_random_words(100) + f.get_words()
+        expected = f.get_word_vectors(words)
+        f.precompute_word_vectors(len(f.get_words()) // 2)
+        self.assertTrue(np.array_equal(f.get_word_vectors(words), expected))
+        with tempfile.NamedTemporaryFile(delete=False) as tmpf:
+            f.save_model(tmpf.name)
+            g = fastText.load_model(tmpf.name)
+        self.assertTrue(np.array_equal(g.get_word_vectors(words), expected))
+
+    def gen_test_load_model_options(self, kwargs):
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = f.get_words()
+        with tempfile.NamedTemporaryFile(delete=False) as tmpf:
+            f.save_model(tmpf.name)
+            g = fastText.load_model(
+                tmpf.name, output=False, max_words=len(words) // 2
+            )
+        self.assertEqual(g.get_words(), words[:len(words) // 2])
+        self.assertEqual(g.get_output_matrix().shape[0], 0)
+        for word in g.get_words():
+            self.assertTrue(
+                np.array_equal(g.get_word_vector(word), f.get_word_vector(word))
+            )
+
+    def gen_test_sentence_vectors(self, kwargs):
+        f = build_supervised_model(get_random_data(100), kwargs)
+        sentences = [" ".join(get_random_words(20)) for _ in range(10)]
+        vectors = f.get_sentence_vectors(sentences, thread=2)
+        self.assertEqual(vectors.shape, (len(sentences), f.get_dimension()))
+        for sentence, vector in zip(sentences, vectors):
+            self.assertTrue(
+                np.allclose(vector, f.get_sentence_vector(sentence))
+            )
+
     def gen_test_newline_predict_sentence(self, kwargs):
         f = build_supervised_model(get_random_data(100), kwargs)
         sentence = " ".join(get_random_words(20))
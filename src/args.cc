@@ -37,12 +37,16 @@ Args::Args() {
   verbose = 2;
   pretrainedVectors = "";
   saveOutput = false;
+  saveSubwords = false;
+  vectorFormat = vector_format::text;
 
   qout = false;
   retrain = false;
   qnorm = false;
   cutoff = 0;
   dsub = 2;
+  nbits = 8;
+  opq = false;
 }
 
 std::string Args::lossToString(loss_name ln) const {
@@ -77,6 +81,18 @@ std::string Args::modelToString(model_name mn) const {
   return "Unknown model name!"; // should never happen
 }
 
+std::string Args::vectorFormatToString(vector_format vf) const {
+  switch (vf) {
+    case vector_format::text:
+      return "text";
+    case vector_format::raw:
+      return "raw";
+    case vector_format::npy:
+      return "npy";
+  }
+  return "Unknown vector format!"; // should never happen
+}
+
 void Args::parseArgs(const std::vector<std::string>& args) {
   std::string command(args[1]);
   if (command == "supervised") {
@@ -153,6 +169,21 @@ void Args::parseArgs(const std::vector<std::string>& args) {
       } else if (args[ai] == "-saveOutput") {
         saveOutput = true;
         ai--;
+      } else if (args[ai] == "-saveSubwords") {
+        saveSubwords = true;
+        ai--;
+      } else if (args[ai] == "-vectorFormat") {
+        if (args.at(ai + 1) == "text") {
+          vectorFormat = vector_format::text;
+        } else if (args.at(ai + 1) == "raw") {
+          vectorFormat = vector_format::raw;
+        } else if (args.at(ai + 1) == "npy") {
+          vectorFormat = vector_format::npy;
+        } else {
+          std::cerr << "Unknown vector format: " << args.at(ai + 1) << std::endl;
+          printHelp();
+          exit(EXIT_FAILURE);
+        }
       } else if (args[ai] == "-qnorm") {
         qnorm = true;
         ai--;
@@ -166,6 +197,11 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         cutoff = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-dsub") {
         dsub = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-nbits") {
+        nbits = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-opq") {
+        opq = true;
+        ai--;
       } else {
         std::cerr << "Unknown argument: " << args[ai] << std::endl;
         printHelp();
@@ -229,7 +265,9 @@ void Args::printTrainingHelp() {
     << "  -loss               loss function {ns, hs, softmax} [" << lossToString(loss) << "]\n"
     << "  -thread             number of threads [" << thread << "]\n"
     << "  -pretrainedVectors  pretrained word vectors for supervised learning ["<< pretrainedVectors <<"]\n"
-    << "  -saveOutput         whether output params should be saved [" << boolToString(saveOutput) << "]\n";
+    << "  -saveOutput         whether output params should be saved [" << boolToString(saveOutput) << "]\n"
+    << "  -saveSubwords       whether the subword ids of the words are saved in the model [" << boolToString(saveSubwords) << "]\n"
+    << "  -vectorFormat       format of the saved word vectors {text, raw, npy} [" << vectorFormatToString(vectorFormat) << "]\n";
 }
 
 void Args::printQuantizationHelp() {
@@ -239,7 +277,9 @@ void Args::printQuantizationHelp() {
     << "  -retrain            whether embeddings are finetuned if a cutoff is applied [" << boolToString(retrain) << "]\n"
     << "  -qnorm              whether the norm is quantized separately [" << boolToString(qnorm) << "]\n"
     << "  -qout               whether the classifier is quantized [" << boolToString(qout) << "]\n"
-    << "  -dsub               size of each sub-vector [" << dsub << "]\n";
+    << "  -dsub               size of each sub-vector [" << dsub << "]\n"
+    << "  -nbits              number of bits per sub-vector code {4, 8} [" << nbits << "]\n"
+    << "  -opq                whether a rotation is learned before quantizing (OPQ) [" << boolToString(opq) << "]\n";
 }
 
 void Args::save(std::ostream& out) {
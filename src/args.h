@@ -18,12 +18,14 @@ namespace fasttext {
 
 enum class model_name : int { cbow = 1, sg, sup };
 enum class loss_name : int { hs = 1, ns, softmax };
+enum class vector_format : int { text = 1, raw, npy };
 
 class Args {
   protected:
     std::string lossToString(loss_name) const;
     std::string boolToString(bool) const;
     std::string modelToString(model_name) const;
+    std::string vectorFormatToString(vector_format) const;
 
   public:
     Args();
@@ -49,12 +51,16 @@ class Args {
     int verbose;
     std::string pretrainedVectors;
     bool saveOutput;
+    bool saveSubwords;
+    vector_format vectorFormat;
 
     bool qout;
     bool retrain;
     bool qnorm;
     size_t cutoff;
     size_t dsub;
+    int nbits;
+    bool opq;
 
     void parseArgs(const std::vector<std::string>& args);
     void printHelp();
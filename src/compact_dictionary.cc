@@ -10,11 +10,60 @@
 #include "compact_dictionary.h"
 #include "fasttext.h"
 #include <cmath>
+#include <cstring>
 #include <list>
 
 
 namespace fasttext {
 
+namespace {
+
+uint64_t alignOffset(uint64_t offset) {
+  return (offset + CompactHeader::ALIGNMENT - 1) / CompactHeader::ALIGNMENT *
+      CompactHeader::ALIGNMENT;
+}
+
+// Pads the file with zeros up to offset, where the next section starts.
+void padTo(FILE* fd, uint64_t offset) {
+  for (uint64_t pos = ftell(fd); pos < offset; pos++) {
+    fputc(0, fd);
+  }
+}
+
+}
+
+void CompactHeader::layout() {
+  magic = MAGIC;
+  version = VERSION;
+  memset(padding, 0, sizeof(padding));
+  hash2id = alignOffset(sizeof(CompactHeader));
+  chars = alignOffset(
+      hash2id + uint64_t(nwords_bucket + nsubs_bucket) * sizeof(int32_t));
+  freqs = alignOffset(chars + nchars);
+  top_words = alignOffset(
+      freqs + uint64_t(nrwords + nsubs_bucket) * sizeof(float));
+  sub_vecs = alignOffset(top_words + uint64_t(nrwords) * ndim * sizeof(float));
+  mins_maxs = alignOffset(sub_vecs + uint64_t(nsubs_bucket) * ndim / 2);
+  size = mins_maxs + uint64_t(nsubs_bucket) * 2 * sizeof(float);
+}
+
+bool CompactHeader::isValid(uint64_t fileSize) const {
+  if (magic != MAGIC || version != VERSION) {
+    return false;
+  }
+  if (nrwords < 1 || nrwords > nwords || nwords_bucket < nwords ||
+      nsubs_bucket < 1 || ndim < 2 || ndim % 2 != 0 || nchars < nrwords ||
+      minn < 0 || maxn < 0) {
+    return false;
+  }
+  CompactHeader expected = *this;
+  expected.layout();
+  return hash2id == expected.hash2id && chars == expected.chars &&
+      freqs == expected.freqs && top_words == expected.top_words &&
+      sub_vecs == expected.sub_vecs && mins_maxs == expected.mins_maxs &&
+      size == expected.size && size <= fileSize;
+}
+
 std::vector<float> CompactDictionary::transform(int32_t ndim, const float* data, const float* map, int32_t map_size) const
 {
     std::vector<float> r(ndim,0.0);
@@ -51,6 +100,7 @@ void CompactDictionary::getSubwordsFrequency(const std::string& word, std::vecto
 void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, std::string map_fn, const FastText& ft, int32_t nrwords) const
 {
     std::shared_ptr<const Matrix> m = ft.getInputMatrix();
+    nrwords = std::min(nrwords, nwords_);
     FILE *fw, *fd, *fmap;
     fw = fopen(word_fn.c_str(), "wb");
     fd = fopen(data_fn.c_str(), "wb");
@@ -98,14 +148,17 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
         fclose(fmap);
     }
 
-    fwrite(&nwords_, sizeof(int32_t), 1, fd); // Number of words
-    fwrite(&nrwords, sizeof(int32_t), 1, fd); // Number of restricted words
-    fwrite(&nwords_bucket, sizeof(int32_t), 1, fd); // Number of words hash
-    fwrite(&(nsubs_bucket), sizeof(int32_t), 1, fd); // Number of subs
-    fwrite(&n_, sizeof(int32_t), 1, fd); // Number of dims
-    fwrite(&nchars, sizeof(int32_t), 1, fd); // min sub
-    fwrite(&minn, sizeof(int8_t), 1, fd); // min sub
-    fwrite(&maxn, sizeof(int8_t), 1, fd); // max sub
+    CompactHeader header;
+    header.nwords = nwords_;
+    header.nrwords = nrwords;
+    header.nwords_bucket = nwords_bucket;
+    header.nsubs_bucket = nsubs_bucket;
+    header.ndim = n_;
+    header.nchars = nchars;
+    header.minn = minn;
+    header.maxn = maxn;
+    header.layout();
+    fwrite(&header, sizeof(CompactHeader), 1, fd);
 
     printf("Processing sizes... done.\n");
     printf("Sorting subs... ");
@@ -120,6 +173,7 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
     
     printf("Processing hash2array... ");
     // hash2array nsubs_bucket
+    padTo(fd, header.hash2id);
     for(int i = 0; i < nwords_bucket; ++i)
         fwrite(&(word2int_[i]), sizeof(int32_t), 1, fd);
     std::vector<int32_t> reverse_sub_map(nsubs_bucket, 0);
@@ -130,6 +184,7 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
     printf("done.\n");
     
     printf("Processing words... ");
+    padTo(fd, header.chars);
     for(int i = 0; i < nrwords; ++i)
     {
         std::string w = getWord(i);
@@ -139,6 +194,7 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
     
     printf("Processing freq... ");
     // freq
+    padTo(fd, header.freqs);
     for(int i = 0; i < nrwords; ++i)
     {
         float freq = words_[i].count/double(ntokens_);
@@ -152,7 +208,8 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
     printf("done.\n");
     
     printf("Processing top words... ");
-    Vector vec(300);
+    padTo(fd, header.top_words);
+    Vector vec(n_);
     const real* data = m->data();
     for(int i = 0; i < nrwords; ++i)
     {
@@ -165,6 +222,7 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
     printf("done.\n");
     
     printf("Processing subwords... \n");
+    padTo(fd, header.sub_vecs);
     uint8_t val = 0;
     std::vector<float> vmm(nsubs_bucket*2, 0.0);
     int32_t ii = 0;
@@ -198,6 +256,7 @@ void CompactDictionary::writeCompact(std::string word_fn, std::string data_fn, s
     printf("done.\n");
 
     printf("Processing min/max... ");
+    padTo(fd, header.mins_maxs);
     fwrite(vmm.data(), sizeof(float), nsubs_bucket*2, fd);
     printf("done.\n");
     fclose(fd);
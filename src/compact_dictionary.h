@@ -14,6 +14,40 @@
 
 namespace fasttext {
 
+// Header of the compact vector file read by the gRPC word vector server.
+// Every section starts at an offset aligned to ALIGNMENT bytes, so that the
+// file can be memory mapped and used in place.
+struct CompactHeader {
+  static const uint32_t MAGIC = 0x46544356; // "VCTF"
+  static const int32_t VERSION = 2;
+  static const uint64_t ALIGNMENT = 64;
+
+  uint32_t magic;
+  int32_t version;
+  int32_t nwords;        // words of the model
+  int32_t nrwords;       // words stored with their vector
+  int32_t nwords_bucket; // size of the word hash table
+  int32_t nsubs_bucket;  // number of subword buckets
+  int32_t ndim;
+  int32_t nchars;        // bytes of the nrwords null terminated words
+  int8_t minn;
+  int8_t maxn;
+  int8_t padding[6];
+  // Section offsets, and the total file size.
+  uint64_t hash2id;   // int32_t[nwords_bucket + nsubs_bucket]
+  uint64_t chars;     // char[nchars]
+  uint64_t freqs;     // float[nrwords + nsubs_bucket]
+  uint64_t top_words; // float[nrwords * ndim]
+  uint64_t sub_vecs;  // uint8_t[nsubs_bucket * ndim / 2], 4 bits per value
+  uint64_t mins_maxs; // float[nsubs_bucket * 2]
+  uint64_t size;
+
+  // Sets magic, version and the offsets from the counts.
+  void layout();
+  // Checks the counts and that the sections fit in a file of the given size.
+  bool isValid(uint64_t fileSize) const;
+};
+
 class CompactDictionary : public Dictionary {
   public:
     void writeCompact(std::string word_fn, std::string data_fn, std::string map_fn, const FastText& ft, int32_t nrwords) const;
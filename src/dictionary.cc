@@ -18,6 +18,9 @@
 #include <cmath>
 #include <stdexcept>
 
+#include "instrument.h"
+#include "utils.h"
+
 namespace fasttext {
 
 const std::string Dictionary::EOS = "</s>";
@@ -28,9 +31,18 @@ Dictionary::Dictionary(std::shared_ptr<Args> args) : args_(args),
   word2int_(MAX_VOCAB_SIZE, -1), size_(0), nwords_(0), nlabels_(0),
   ntokens_(0), pruneidx_size_(-1) {}
 
-Dictionary::Dictionary(std::shared_ptr<Args> args, std::istream& in) : args_(args),
-  size_(0), nwords_(0), nlabels_(0), ntokens_(0), pruneidx_size_(-1) {
-  load(in);
+Dictionary::Dictionary(
+    std::shared_ptr<Args> args,
+    std::istream& in,
+    int32_t maxWords,
+    int64_t subwords)
+    : args_(args),
+      size_(0),
+      nwords_(0),
+      nlabels_(0),
+      ntokens_(0),
+      pruneidx_size_(-1) {
+  load(in, maxWords, subwords);
 }
 
 int32_t Dictionary::find(const std::string& w) const {
@@ -177,33 +189,39 @@ void Dictionary::computeSubwords(const std::string& word,
   }
 }
 
+// Same as above without the substrings. The hash of each n-gram is carried
+// over from the one it extends instead of being computed from scratch.
 void Dictionary::computeSubwords(const std::string& word,
                                std::vector<int32_t>& ngrams) const {
   for (size_t i = 0; i < word.size(); i++) {
-    std::string ngram;
     if ((word[i] & 0xC0) == 0x80) continue;
+    uint32_t h = 2166136261;
     for (size_t j = i, n = 1; j < word.size() && n <= args_->maxn; n++) {
-      ngram.push_back(word[j++]);
-      while (j < word.size() && (word[j] & 0xC0) == 0x80) {
-        ngram.push_back(word[j++]);
-      }
+      do {
+        h = h ^ uint32_t(int8_t(word[j++]));
+        h = h * 16777619;
+      } while (j < word.size() && (word[j] & 0xC0) == 0x80);
       if (n >= args_->minn && !(n == 1 && (i == 0 || j == word.size()))) {
-        int32_t h = hash(ngram) % args_->bucket;
-        pushHash(ngrams, h);
+        pushHash(ngrams, h % args_->bucket);
       }
     }
   }
 }
 
 void Dictionary::initNgrams() {
-  for (size_t i = 0; i < size_; i++) {
-    std::string word = BOW + words_[i].word + EOW;
-    words_[i].subwords.clear();
-    words_[i].subwords.push_back(i);
-    if (words_[i].word != EOS) {
-      computeSubwords(word, words_[i].subwords);
+  utils::parallelFor(0, size_, args_->thread, [&](int64_t begin, int64_t end) {
+    std::string word;
+    std::vector<int32_t> subwords;
+    for (int64_t i = begin; i < end; i++) {
+      word.assign(BOW).append(words_[i].word).append(EOW);
+      subwords.assign(1, i);
+      if (words_[i].word != EOS) {
+        computeSubwords(word, subwords);
+      }
+      // Copied to fit, rather than grown in place with up to twice the room.
+      words_[i].subwords.assign(subwords.begin(), subwords.end());
     }
-  }
+  });
 }
 
 bool Dictionary::readWord(std::istream& in, std::string& word) const
@@ -233,6 +251,32 @@ bool Dictionary::readWord(std::istream& in, std::string& word) const
   return !word.empty();
 }
 
+// Same as above, reading from the buffer [begin, end) instead of a stream.
+// begin is advanced past the word.
+bool Dictionary::readWord(const char*& begin, const char* end,
+                          std::string& word) const {
+  word.clear();
+  while (begin != end) {
+    char c = *begin;
+    if (c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == '\v' ||
+        c == '\f' || c == '\0') {
+      if (word.empty()) {
+        begin++;
+        if (c == '\n') {
+          word += EOS;
+          return true;
+        }
+        continue;
+      } else {
+        return true;
+      }
+    }
+    word.push_back(c);
+    begin++;
+  }
+  return !word.empty();
+}
+
 void Dictionary::readFromFile(std::istream& in) {
   std::string word;
   int64_t minThreshold = 1;
@@ -337,6 +381,7 @@ void Dictionary::reset(std::istream& in) const {
 int32_t Dictionary::getLine(std::istream& in,
                             std::vector<int32_t>& words,
                             std::minstd_rand& rng) const {
+  FASTTEXT_PROBE(getLine);
   std::uniform_real_distribution<> uniform(0, 1);
   std::string token;
   int32_t ntokens = 0;
@@ -362,23 +407,86 @@ int32_t Dictionary::getLine(std::istream& in,
                             std::vector<int32_t>& labels) const {
   std::vector<int32_t> word_hashes;
   std::string token;
+  return getLine(in, words, labels, word_hashes, token);
+}
+
+void Dictionary::addToken(const std::string& token,
+                          std::vector<int32_t>& words,
+                          std::vector<int32_t>& labels,
+                          std::vector<int32_t>& word_hashes) const {
+  uint32_t h = hash(token);
+  int32_t wid = getId(token, h);
+  entry_type type = wid < 0 ? getType(token) : getType(wid);
+
+  if (type == entry_type::word) {
+    addSubwords(words, token, wid);
+    word_hashes.push_back(h);
+  } else if (type == entry_type::label && wid >= 0) {
+    labels.push_back(wid - nwords_);
+  }
+}
+
+// Same as above, with the scratch buffers provided by the caller so that
+// they can be reused from one line to the next.
+int32_t Dictionary::getLine(std::istream& in,
+                            std::vector<int32_t>& words,
+                            std::vector<int32_t>& labels,
+                            std::vector<int32_t>& word_hashes,
+                            std::string& token) const {
+  FASTTEXT_PROBE(getLine);
   int32_t ntokens = 0;
 
   reset(in);
   words.clear();
   labels.clear();
+  word_hashes.clear();
   while (readWord(in, token)) {
-    uint32_t h = hash(token);
-    int32_t wid = getId(token, h);
-    entry_type type = wid < 0 ? getType(token) : getType(wid);
+    ntokens++;
+    addToken(token, words, labels, word_hashes);
+    if (token == EOS) break;
+  }
+  addWordNgrams(words, word_hashes, args_->wordNgrams);
+  return ntokens;
+}
+
+// Reads the first line of the buffer text of the given length in place,
+// without building a stream around it.
+int32_t Dictionary::getLine(const char* text,
+                            size_t length,
+                            std::vector<int32_t>& words,
+                            std::vector<int32_t>& labels,
+                            std::vector<int32_t>& word_hashes,
+                            std::string& token) const {
+  FASTTEXT_PROBE(getLine);
+  const char* end = text + length;
+  int32_t ntokens = 0;
 
+  words.clear();
+  labels.clear();
+  word_hashes.clear();
+  while (readWord(text, end, token)) {
     ntokens++;
-    if (type == entry_type::word) {
-      addSubwords(words, token, wid);
-      word_hashes.push_back(h);
-    } else if (type == entry_type::label && wid >= 0) {
-      labels.push_back(wid - nwords_);
-    }
+    addToken(token, words, labels, word_hashes);
+    if (token == EOS) break;
+  }
+  addWordNgrams(words, word_hashes, args_->wordNgrams);
+  return ntokens;
+}
+
+// Same as above for a line that is already split into tokens.
+int32_t Dictionary::getLine(const std::vector<std::string>& tokens,
+                            std::vector<int32_t>& words,
+                            std::vector<int32_t>& labels,
+                            std::vector<int32_t>& word_hashes) const {
+  FASTTEXT_PROBE(getLine);
+  int32_t ntokens = 0;
+
+  words.clear();
+  labels.clear();
+  word_hashes.clear();
+  for (const auto& token : tokens) {
+    ntokens++;
+    addToken(token, words, labels, word_hashes);
     if (token == EOS) break;
   }
   addWordNgrams(words, word_hashes, args_->wordNgrams);
@@ -424,23 +532,103 @@ void Dictionary::save(std::ostream& out) const {
   }
 }
 
-void Dictionary::load(std::istream& in) {
+// Writes the subword ids of all entries, as saved by save, in CSR form:
+// size_ + 1 offsets into their concatenation, then the ids themselves.
+// They are preceded by what they depend on, so that load can tell whether
+// they still apply.
+void Dictionary::saveSubwords(std::ostream& out) const {
+  out.write((char*) &args_->minn, sizeof(int32_t));
+  out.write((char*) &args_->maxn, sizeof(int32_t));
+  out.write((char*) &args_->bucket, sizeof(int32_t));
+  out.write((char*) &size_, sizeof(int32_t));
+  out.write((char*) &nwords_, sizeof(int32_t));
+  int64_t offset = 0;
+  out.write((char*) &offset, sizeof(int64_t));
+  for (const auto& e : words_) {
+    offset += e.subwords.size();
+    out.write((char*) &offset, sizeof(int64_t));
+  }
+  for (const auto& e : words_) {
+    out.write((char*) e.subwords.data(), e.subwords.size() * sizeof(int32_t));
+  }
+}
+
+// Reads the subword ids written by saveSubwords for a dictionary of size
+// entries and nwords words, of which load kept the first nwords_ words and
+// all the labels. Returns false, leaving them to be recomputed, if they do
+// not match.
+bool Dictionary::loadSubwords(
+    std::istream& in,
+    int32_t size,
+    int32_t nwords) {
+  int32_t header[5];
+  in.read((char*) header, sizeof(header));
+  if (!in || header[0] != args_->minn || header[1] != args_->maxn ||
+      header[2] != args_->bucket || header[3] != size || header[4] != nwords) {
+    return false;
+  }
+  std::vector<int64_t> offsets(size + 1);
+  in.read((char*) offsets.data(), offsets.size() * sizeof(int64_t));
+  if (!in || offsets[0] != 0) {
+    return false;
+  }
+  for (int32_t j = 0; j < size; j++) {
+    if (offsets[j + 1] <= offsets[j]) {
+      return false;
+    }
+  }
+  // Dropped words shift the labels and the subword ids that follow them.
+  std::streampos ids = in.tellg();
+  int32_t shift = nwords - nwords_;
+  for (int32_t i = 0; i < size_; i++) {
+    int32_t j = i < nwords_ ? i : i + shift;
+    if (i == nwords_ && shift > 0) {
+      in.seekg(ids + std::streamoff(offsets[j] * sizeof(int32_t)));
+    }
+    std::vector<int32_t>& subwords = words_[i].subwords;
+    subwords.resize(offsets[j + 1] - offsets[j]);
+    in.read((char*) subwords.data(), subwords.size() * sizeof(int32_t));
+    if (!in || subwords[0] != j) {
+      return false;
+    }
+    subwords[0] = i;
+    for (size_t k = 1; k < subwords.size(); k++) {
+      subwords[k] -= shift;
+    }
+  }
+  return true;
+}
+
+// If maxWords is not negative, only the maxWords most frequent words are
+// kept, the others becoming out of vocabulary; subword ids then start right
+// after the kept words. If subwords is not negative, it is the position in
+// in of the output of saveSubwords, read instead of hashing every subword
+// again.
+void Dictionary::load(std::istream& in, int32_t maxWords, int64_t subwords) {
   words_.clear();
   in.read((char*) &size_, sizeof(int32_t));
   in.read((char*) &nwords_, sizeof(int32_t));
   in.read((char*) &nlabels_, sizeof(int32_t));
   in.read((char*) &ntokens_, sizeof(int64_t));
   in.read((char*) &pruneidx_size_, sizeof(int64_t));
+  int32_t size = size_;
+  int32_t nwords = nwords_;
+  if (maxWords < 0 || maxWords > nwords_) {
+    maxWords = nwords_;
+  }
+  words_.reserve(maxWords + nlabels_);
   for (int32_t i = 0; i < size_; i++) {
-    char c;
     entry e;
-    while ((c = in.get()) != 0) {
-      e.word.push_back(c);
-    }
+    std::getline(in, e.word, '\0');
     in.read((char*) &e.count, sizeof(int64_t));
     in.read((char*) &e.type, sizeof(entry_type));
-    words_.push_back(e);
+    if (e.type == entry_type::word && i >= maxWords) {
+      continue;
+    }
+    words_.push_back(std::move(e));
   }
+  size_ = words_.size();
+  nwords_ = maxWords;
   pruneidx_.clear();
   for (int32_t i = 0; i < pruneidx_size_; i++) {
     int32_t first;
@@ -450,12 +638,30 @@ void Dictionary::load(std::istream& in) {
     pruneidx_[first] = second;
   }
   initTableDiscard();
-  initNgrams();
+  bool loaded = false;
+  if (subwords >= 0) {
+    std::streampos end = in.tellg();
+    in.seekg(subwords);
+    loaded = loadSubwords(in, size, nwords);
+    in.clear();
+    in.seekg(end);
+  }
+  if (!loaded) {
+    initNgrams();
+  }
 
+  // Hashing the words is the costly part of filling word2int_, and unlike
+  // the probing it can be split across threads.
+  std::vector<uint32_t> hashes(size_);
+  utils::parallelFor(0, size_, args_->thread, [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; i++) {
+      hashes[i] = hash(words_[i].word);
+    }
+  });
   int32_t word2intsize = std::ceil(size_ / 0.7);
   word2int_.assign(word2intsize, -1);
   for (int32_t i = 0; i < size_; i++) {
-    word2int_[find(words_[i].word)] = i;
+    word2int_[find(words_[i].word, hashes[i])] = i;
   }
 }
 
@@ -471,6 +677,7 @@ void Dictionary::prune(std::vector<int32_t>& idx) {
     else {ngrams.push_back(*it);}
   }
   std::sort(words.begin(), words.end());
+  std::sort(ngrams.begin(), ngrams.end());
   idx = words;
 
   if (ngrams.size() != 0) {
@@ -41,9 +41,15 @@ class Dictionary {
     int32_t find(const std::string&, uint32_t h) const;
     void initTableDiscard();
     void initNgrams();
+    bool loadSubwords(std::istream&, int32_t, int32_t);
     void reset(std::istream&) const;
     void pushHash(std::vector<int32_t>&, int32_t) const;
     void addSubwords(std::vector<int32_t>&, const std::string&, int32_t) const;
+    void addToken(
+        const std::string&,
+        std::vector<int32_t>&,
+        std::vector<int32_t>&,
+        std::vector<int32_t>&) const;
 
     std::shared_ptr<Args> args_;
     std::vector<int32_t> word2int_;
@@ -69,7 +75,11 @@ class Dictionary {
     static const std::string EOW;
 
     explicit Dictionary(std::shared_ptr<Args>);
-    explicit Dictionary(std::shared_ptr<Args>, std::istream&);
+    explicit Dictionary(
+        std::shared_ptr<Args>,
+        std::istream&,
+        int32_t = -1,
+        int64_t = -1);
     int32_t nwords() const;
     int32_t nlabels() const;
     int64_t ntokens() const;
@@ -93,13 +103,22 @@ class Dictionary {
     uint32_t hash(const std::string& str) const;
     void add(const std::string&);
     bool readWord(std::istream&, std::string&) const;
+    bool readWord(const char*&, const char*, std::string&) const;
     void readFromFile(std::istream&);
     std::string getLabel(int32_t) const;
     void save(std::ostream&) const;
-    void load(std::istream&);
+    void load(std::istream&, int32_t = -1, int64_t = -1);
+    void saveSubwords(std::ostream&) const;
     std::vector<int64_t> getCounts(entry_type) const;
     int32_t getLine(std::istream&, std::vector<int32_t>&, std::vector<int32_t>&)
         const;
+    int32_t getLine(std::istream&, std::vector<int32_t>&, std::vector<int32_t>&,
+                    std::vector<int32_t>&, std::string&) const;
+    int32_t getLine(const char*, size_t, std::vector<int32_t>&,
+                    std::vector<int32_t>&, std::vector<int32_t>&,
+                    std::string&) const;
+    int32_t getLine(const std::vector<std::string>&, std::vector<int32_t>&,
+                    std::vector<int32_t>&, std::vector<int32_t>&) const;
     int32_t getLine(std::istream&, std::vector<int32_t>&,
                     std::minstd_rand&) const;
     void threshold(int64_t, int64_t);
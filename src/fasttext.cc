@@ -18,14 +18,194 @@
 #include <algorithm>
 #include <stdexcept>
 #include <numeric>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <future>
 
 
 namespace fasttext {
 
-constexpr int32_t FASTTEXT_VERSION = 12; /* Version 1b */
+constexpr int32_t FASTTEXT_VERSION = 14; /* Version 1d */
 constexpr int32_t FASTTEXT_FILEFORMAT_MAGIC_INT32 = 793712314;
+constexpr int32_t FASTTEXT_WORD_VECTORS_MAGIC_INT32 = 793712315;
+constexpr int32_t FASTTEXT_TOC_MAGIC_INT32 = 793712316;
+constexpr int32_t FASTTEXT_SUBWORDS_MAGIC_INT32 = 793712317;
+
+namespace {
+
+constexpr size_t VECTORS_BLOCK_SIZE = 1 << 24;
+
+// findNNBatch scores groups of NN_QUERY_BLOCK queries against tiles of
+// NN_WORD_BLOCK word vectors, NN_QUERY_LANES queries by NN_WORD_STEP words
+// at a time.
+constexpr int64_t NN_QUERY_LANES = 16;
+constexpr int64_t NN_QUERY_BLOCK = 256;
+constexpr int64_t NN_WORD_BLOCK = 512;
+constexpr int64_t NN_WORD_STEP = 4;
+
+// Model files end with a table of contents giving the offset and size of
+// each of their sections, followed by its own offset and magic number.
+// Readers that predate it stop after the output matrix and never see it.
+enum class model_section : int32_t {
+  args = 1,
+  dictionary,
+  input,
+  output,
+  word_vectors,
+  subwords
+};
+
+struct ModelSection {
+  model_section id;
+  int64_t offset;
+  int64_t size;
+};
+
+void beginSection(
+    std::ostream& out,
+    model_section id,
+    std::vector<ModelSection>& toc) {
+  toc.push_back({id, int64_t(out.tellp()), 0});
+}
+
+void endSection(std::ostream& out, std::vector<ModelSection>& toc) {
+  toc.back().size = int64_t(out.tellp()) - toc.back().offset;
+}
+
+void writeTableOfContents(
+    std::ostream& out,
+    const std::vector<ModelSection>& toc) {
+  const int32_t magic = FASTTEXT_TOC_MAGIC_INT32;
+  int64_t offset = out.tellp();
+  int32_t count = toc.size();
+  out.write((char*)&(magic), sizeof(int32_t));
+  out.write((char*)&(count), sizeof(int32_t));
+  for (const auto& section : toc) {
+    out.write((char*)&(section.id), sizeof(int32_t));
+    out.write((char*)&(section.offset), sizeof(int64_t));
+    out.write((char*)&(section.size), sizeof(int64_t));
+  }
+  out.write((char*)&(offset), sizeof(int64_t));
+  out.write((char*)&(magic), sizeof(int32_t));
+}
+
+// Reads the table of contents of the model in, if it has one and can seek,
+// leaving its position unchanged.
+bool readTableOfContents(std::istream& in, std::vector<ModelSection>& toc) {
+  toc.clear();
+  std::streampos pos = in.tellg();
+  if (pos == std::streampos(-1)) {
+    return false;
+  }
+  int64_t offset;
+  int32_t magic = 0;
+  in.seekg(-int64_t(sizeof(int64_t) + sizeof(int32_t)), std::ios_base::end);
+  in.read((char*) &offset, sizeof(int64_t));
+  in.read((char*) &magic, sizeof(int32_t));
+  bool found = in && magic == FASTTEXT_TOC_MAGIC_INT32;
+  if (found) {
+    int32_t count = 0;
+    in.seekg(offset);
+    in.read((char*) &magic, sizeof(int32_t));
+    in.read((char*) &count, sizeof(int32_t));
+    for (int32_t i = 0; in && i < count; i++) {
+      ModelSection section;
+      in.read((char*) &section.id, sizeof(int32_t));
+      in.read((char*) &section.offset, sizeof(int64_t));
+      in.read((char*) &section.size, sizeof(int64_t));
+      toc.push_back(section);
+    }
+    found = in && magic == FASTTEXT_TOC_MAGIC_INT32;
+  }
+  if (!found) {
+    toc.clear();
+  }
+  in.clear();
+  in.seekg(pos);
+  return found;
+}
+
+const ModelSection* findSection(
+    const std::vector<ModelSection>& toc,
+    model_section id) {
+  for (const auto& section : toc) {
+    if (section.id == id) {
+      return &section;
+    }
+  }
+  return nullptr;
+}
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+  return str.size() >= suffix.size() &&
+      str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+const char* skipSpaces(const char* p, const char* end) {
+  while (p < end && std::isspace((unsigned char) *p)) {
+    p++;
+  }
+  return p;
+}
+
+const char* skipToken(const char* p, const char* end) {
+  while (p < end && !std::isspace((unsigned char) *p)) {
+    p++;
+  }
+  return p;
+}
+
+// Reads in up to its end and calls fn on successive blocks of whole lines,
+// the last one possibly missing its newline. Blocks grow to fit a line.
+void forEachLineBlock(
+    std::istream& in,
+    const std::function<void(const char*, const char*)>& fn) {
+  std::vector<char> buffer(VECTORS_BLOCK_SIZE);
+  size_t size = 0;
+  while (in) {
+    in.read(buffer.data() + size, buffer.size() - size);
+    size += in.gcount();
+    size_t last = size;
+    if (in) {
+      while (last > 0 && buffer[last - 1] != '\n') {
+        last--;
+      }
+      if (last == 0) {
+        buffer.resize(2 * buffer.size());
+        continue;
+      }
+    }
+    fn(buffer.data(), buffer.data() + last);
+    std::memmove(buffer.data(), buffer.data() + last, size - last);
+    size -= last;
+  }
+}
 
-FastText::FastText() : quant_(false) {}
+// Splits [begin, end) into its lines that are not blank, up to max of them.
+void splitLines(
+    const char* begin,
+    const char* end,
+    size_t max,
+    std::vector<std::pair<const char*, const char*>>& lines) {
+  lines.clear();
+  while (begin < end && lines.size() < max) {
+    const char* eol = (const char*) std::memchr(begin, '\n', end - begin);
+    eol = eol ? eol : end;
+    if (skipSpaces(begin, eol) < eol) {
+      lines.emplace_back(begin, eol);
+    }
+    begin = eol + 1;
+  }
+}
+
+}
+
+FastText::FastText()
+    : wordVectors_(std::make_shared<Matrix>()), quant_(false) {}
 
 void FastText::addInputVector(Vector& vec, int32_t ind) const {
   if (quant_) {
@@ -35,6 +215,18 @@ void FastText::addInputVector(Vector& vec, int32_t ind) const {
   }
 }
 
+void FastText::addInputVectors(
+    Vector& vec,
+    const std::vector<int32_t>& inds) const {
+  if (quant_) {
+    qinput_->addRowsToVector(vec, inds);
+  } else {
+    for (auto it = inds.cbegin(); it != inds.cend(); ++it) {
+      vec.addRow(*input_, *it);
+    }
+  }
+}
+
 std::shared_ptr<const Dictionary> FastText::getDictionary() const {
   return dict_;
 }
@@ -61,16 +253,33 @@ int32_t FastText::getSubwordId(const std::string& word) const {
 }
 
 void FastText::getWordVector(Vector& vec, const std::string& word) const {
-  const std::vector<int32_t>& ngrams = dict_->getSubwords(word);
-  vec.zero();
-  for (int i = 0; i < ngrams.size(); i ++) {
-    addInputVector(vec, ngrams[i]);
-  }
-  if (ngrams.size() > 0) {
-    vec.mul(1.0 / ngrams.size());
+  int32_t id = dict_->getId(word);
+  if (id < 0) {
+    averageInputVectors(vec, dict_->getSubwords(word));
+  } else if (id < wordVectors_->rows()) {
+    const real* row = wordVectors_->data() + id * wordVectors_->cols();
+    std::copy(row, row + wordVectors_->cols(), vec.data());
+  } else {
+    averageInputVectors(vec, dict_->getSubwords(id));
   }
 }
 
+// Writes the vector of words[i] to row i of the (words.size() x dim)
+// row-major array out.
+void FastText::getWordVectors(
+    const std::vector<std::string>& words,
+    real* out,
+    int32_t nthreads) const {
+  int64_t dim = args_->dim;
+  utils::parallelFor(0, words.size(), nthreads, [&](int64_t begin, int64_t end) {
+    Vector vec(dim);
+    for (int64_t i = begin; i < end; i++) {
+      getWordVector(vec, words[i]);
+      std::copy(vec.data(), vec.data() + dim, out + i * dim);
+    }
+  });
+}
+
 void FastText::getVector(Vector& vec, const std::string& word) const {
   getWordVector(vec, word);
 }
@@ -83,18 +292,84 @@ void FastText::getSubwordVector(Vector& vec, const std::string& subword)
   addInputVector(vec, h);
 }
 
+// Writes the vectors of the words of the dictionary to args_->output.vec
+// as text, or as raw float32 rows (.f32) or a NumPy array (.npy) along
+// with the words, one per line, in .vocab. The vectors are computed and
+// formatted by args_->thread threads, a block of words at a time.
 void FastText::saveVectors() {
-  std::ofstream ofs(args_->output + ".vec");
+  std::string extension;
+  switch (args_->vectorFormat) {
+    case vector_format::text:
+      extension = ".vec";
+      break;
+    case vector_format::raw:
+      extension = ".f32";
+      break;
+    case vector_format::npy:
+      extension = ".npy";
+      break;
+  }
+  std::string filename = args_->output + extension;
+  std::ofstream ofs(
+      filename,
+      args_->vectorFormat == vector_format::text
+          ? std::ofstream::out
+          : std::ofstream::out | std::ofstream::binary);
   if (!ofs.is_open()) {
     throw std::invalid_argument(
-        args_->output + ".vec" + " cannot be opened for saving vectors!");
+        filename + " cannot be opened for saving vectors!");
   }
-  ofs << dict_->nwords() << " " << args_->dim << std::endl;
-  Vector vec(args_->dim);
-  for (int32_t i = 0; i < dict_->nwords(); i++) {
-    std::string word = dict_->getWord(i);
-    getWordVector(vec, word);
-    ofs << word << " " << vec << std::endl;
+  std::ofstream vocab;
+  if (args_->vectorFormat != vector_format::text) {
+    vocab.open(args_->output + ".vocab");
+    if (!vocab.is_open()) {
+      throw std::invalid_argument(
+          args_->output + ".vocab cannot be opened for saving vectors!");
+    }
+  }
+  int64_t nwords = dict_->nwords();
+  int64_t dim = args_->dim;
+  if (args_->vectorFormat == vector_format::text) {
+    ofs << nwords << " " << dim << std::endl;
+  } else if (args_->vectorFormat == vector_format::npy) {
+    utils::writeNpyHeader(ofs, nwords, dim);
+  }
+  const int64_t blockSize = 4096;
+  std::vector<std::string> words(blockSize);
+  std::vector<std::string> lines(blockSize);
+  std::vector<real> vectors(blockSize * dim);
+  for (int64_t block = 0; block < nwords; block += blockSize) {
+    int64_t n = std::min(blockSize, nwords - block);
+    utils::parallelFor(0, n, args_->thread, [&](int64_t begin, int64_t end) {
+      Vector vec(dim);
+      char buffer[32];
+      for (int64_t i = begin; i < end; i++) {
+        words[i] = dict_->getWord(block + i);
+        getWordVector(vec, words[i]);
+        if (args_->vectorFormat != vector_format::text) {
+          std::copy(vec.data(), vec.data() + dim, vectors.data() + i * dim);
+          continue;
+        }
+        std::string& line = lines[i];
+        line = words[i];
+        line += ' ';
+        for (int64_t j = 0; j < dim; j++) {
+          line.append(buffer, utils::formatReal(vec[j], 5, buffer));
+          line += ' ';
+        }
+        line += '\n';
+      }
+    });
+    if (args_->vectorFormat == vector_format::text) {
+      for (int64_t i = 0; i < n; i++) {
+        ofs << lines[i];
+      }
+    } else {
+      ofs.write((char*) vectors.data(), n * dim * sizeof(real));
+      for (int64_t i = 0; i < n; i++) {
+        vocab << words[i] << '\n';
+      }
+    }
   }
   ofs.close();
 }
@@ -154,32 +429,69 @@ void FastText::saveModel() {
 }
 
 void FastText::saveModel(const std::string path) {
+  if (!loadOptions_.output || loadOptions_.maxWords >= 0) {
+    throw std::invalid_argument(
+        "Cannot save a model loaded without all of its words and matrices.");
+  }
   std::ofstream ofs(path, std::ofstream::binary);
   if (!ofs.is_open()) {
     throw std::invalid_argument(path + " cannot be opened for saving!");
   }
+  std::vector<ModelSection> toc;
   signModel(ofs);
+  beginSection(ofs, model_section::args, toc);
   args_->save(ofs);
+  endSection(ofs, toc);
+  beginSection(ofs, model_section::dictionary, toc);
   dict_->save(ofs);
+  endSection(ofs, toc);
 
+  beginSection(ofs, model_section::input, toc);
   ofs.write((char*)&(quant_), sizeof(bool));
   if (quant_) {
     qinput_->save(ofs);
   } else {
     input_->save(ofs);
   }
+  endSection(ofs, toc);
 
+  beginSection(ofs, model_section::output, toc);
   ofs.write((char*)&(args_->qout), sizeof(bool));
   if (quant_ && args_->qout) {
     qoutput_->save(ofs);
   } else {
     output_->save(ofs);
   }
+  endSection(ofs, toc);
+
+  if (wordVectors_->rows() > 0) {
+    const int32_t magic = FASTTEXT_WORD_VECTORS_MAGIC_INT32;
+    beginSection(ofs, model_section::word_vectors, toc);
+    ofs.write((char*)&(magic), sizeof(int32_t));
+    wordVectors_->save(ofs);
+    endSection(ofs, toc);
+  }
+
+  // Spares loadModel from hashing the subwords of every word again.
+  if (args_->saveSubwords && args_->maxn > 0) {
+    const int32_t magic = FASTTEXT_SUBWORDS_MAGIC_INT32;
+    beginSection(ofs, model_section::subwords, toc);
+    ofs.write((char*)&(magic), sizeof(int32_t));
+    dict_->saveSubwords(ofs);
+    endSection(ofs, toc);
+  }
 
+  writeTableOfContents(ofs, toc);
   ofs.close();
 }
 
 void FastText::loadModel(const std::string& filename) {
+  loadModel(filename, LoadOptions());
+}
+
+void FastText::loadModel(
+    const std::string& filename,
+    const LoadOptions& options) {
   std::ifstream ifs(filename, std::ifstream::binary);
   if (!ifs.is_open()) {
     throw std::invalid_argument(filename + " cannot be opened for loading!");
@@ -187,57 +499,186 @@ void FastText::loadModel(const std::string& filename) {
   if (!checkModel(ifs)) {
     throw std::invalid_argument(filename + " has wrong file format!");
   }
-  loadModel(ifs);
+  loadModel(ifs, options, filename);
   ifs.close();
 }
 
 void FastText::loadModel(std::istream& in) {
+  loadModel(in, LoadOptions());
+}
+
+void FastText::loadModel(std::istream& in, const LoadOptions& options) {
+  loadModel(in, options, std::string());
+}
+
+// Reads the flag and the matrix that saveModel writes for the input layer.
+void FastText::loadInput(std::istream& in, const LoadOptions& options) {
+  bool quant_input;
+  in.read((char*) &quant_input, sizeof(bool));
+  if (quant_input) {
+    if (options.maxWords >= 0) {
+      throw std::invalid_argument(
+          "Loading fewer words is not supported for quantized models.");
+    }
+    quant_ = true;
+    qinput_->load(in, version);
+  } else if (options.maxWords >= 0) {
+    // The rows of the kept words come first and those of the buckets last.
+    input_->load(in, options.maxWords, args_->bucket);
+  } else {
+    input_->load(in);
+  }
+}
+
+// Same for the output layer, which is quantized only if the input is.
+void FastText::loadOutput(
+    std::istream& in,
+    const LoadOptions& options,
+    bool quant_input) {
+  in.read((char*) &args_->qout, sizeof(bool));
+  if (quant_input && args_->qout) {
+    qoutput_->load(in, version);
+  } else if (options.maxWords >= 0 && args_->model != model_name::sup) {
+    output_->load(in, options.maxWords, 0);
+  } else {
+    output_->load(in);
+  }
+}
+
+// When the model comes from filename and has a table of contents, its
+// matrices are read from streams of their own while the dictionary is
+// parsed from in.
+void FastText::loadModel(
+    std::istream& in,
+    const LoadOptions& options,
+    const std::string& filename) {
+  std::vector<ModelSection> toc;
+  bool hasToc = readTableOfContents(in, toc);
+  loadOptions_ = options;
+  quant_ = false;
   args_ = std::make_shared<Args>();
   input_ = std::make_shared<Matrix>();
   output_ = std::make_shared<Matrix>();
   qinput_ = std::make_shared<QMatrix>();
   qoutput_ = std::make_shared<QMatrix>();
+  wordVectors_ = std::make_shared<Matrix>();
   args_->load(in);
   if (version == 11 && args_->model == model_name::sup) {
     // backward compatibility: old supervised models do not use char ngrams.
     args_->maxn = 0;
   }
-  dict_ = std::make_shared<Dictionary>(args_, in);
 
-  bool quant_input;
-  in.read((char*) &quant_input, sizeof(bool));
-  if (quant_input) {
-    quant_ = true;
-    qinput_->load(in);
+  const ModelSection* input =
+      hasToc ? findSection(toc, model_section::input) : nullptr;
+  const ModelSection* output =
+      hasToc ? findSection(toc, model_section::output) : nullptr;
+  bool concurrent = !filename.empty() && input && output;
+  std::future<void> inputLoaded, outputLoaded;
+  if (concurrent) {
+    inputLoaded = std::async(std::launch::async, [&]() {
+      std::ifstream ifs(filename, std::ifstream::binary);
+      ifs.seekg(input->offset);
+      loadInput(ifs, options);
+    });
+  }
+  if (concurrent && options.output) {
+    outputLoaded = std::async(std::launch::async, [&]() {
+      std::ifstream ifs(filename, std::ifstream::binary);
+      bool quant_input;
+      ifs.seekg(input->offset);
+      ifs.read((char*) &quant_input, sizeof(bool));
+      ifs.seekg(output->offset);
+      loadOutput(ifs, options, quant_input);
+    });
+  }
+
+  const ModelSection* subwords =
+      hasToc ? findSection(toc, model_section::subwords) : nullptr;
+  dict_ = std::make_shared<Dictionary>(
+      args_,
+      in,
+      options.maxWords,
+      subwords ? subwords->offset + int64_t(sizeof(int32_t)) : -1);
+  // Saving the model again keeps the section.
+  args_->saveSubwords = subwords != nullptr;
+
+  if (concurrent) {
+    inputLoaded.get();
   } else {
-    input_->load(in);
+    loadInput(in, options);
   }
 
-  if (!quant_input && dict_->isPruned()) {
+  if (!quant_ && dict_->isPruned()) {
     throw std::invalid_argument(
         "Invalid model file.\n"
         "Please download the updated model from www.fasttext.cc.\n"
         "See issue #332 on Github for more information.\n");
   }
 
-  in.read((char*) &args_->qout, sizeof(bool));
-  if (quant_ && args_->qout) {
-    qoutput_->load(in);
+  if (options.output) {
+    if (concurrent) {
+      outputLoaded.get();
+    } else {
+      loadOutput(in, options, quant_);
+    }
   } else {
-    output_->load(in);
+    if (output) {
+      in.seekg(output->offset);
+    }
+    in.read((char*) &args_->qout, sizeof(bool));
+    // Without a table of contents, the output matrix is read through to
+    // reach the sections that follow it.
+    if (!hasToc && quant_ && args_->qout) {
+      QMatrix().load(in, version);
+    } else if (!hasToc) {
+      Matrix().load(in, 0, 0);
+    }
+  }
+
+  const ModelSection* table =
+      hasToc ? findSection(toc, model_section::word_vectors) : nullptr;
+  if (table) {
+    in.seekg(table->offset);
+  }
+  if (options.wordVectors && (table || (!hasToc &&
+      in.peek() != std::char_traits<char>::eof()))) {
+    int32_t magic;
+    in.read((char*) &magic, sizeof(int32_t));
+    if (magic == FASTTEXT_WORD_VECTORS_MAGIC_INT32) {
+      if (options.maxWords >= 0) {
+        wordVectors_->load(in, dict_->nwords(), 0);
+      } else {
+        wordVectors_->load(in);
+      }
+      if (!in || wordVectors_->rows() > dict_->nwords() ||
+          wordVectors_->cols() != args_->dim) {
+        throw std::invalid_argument(
+            "Invalid model file: bad word vector table.");
+      }
+    } else if (magic != FASTTEXT_SUBWORDS_MAGIC_INT32 &&
+               magic != FASTTEXT_TOC_MAGIC_INT32) {
+      throw std::invalid_argument("Invalid model file: unknown section.");
+    }
   }
 
   model_ = std::make_shared<Model>(input_, output_, args_, 0);
   model_->quant_ = quant_;
   model_->setQuantizePointer(qinput_, qoutput_, args_->qout);
 
-  if (args_->model == model_name::sup) {
-    model_->setTargetCounts(dict_->getCounts(entry_type::label));
-  } else {
-    model_->setTargetCounts(dict_->getCounts(entry_type::word));
+  // Target counts only serve the output layer.
+  if (options.output) {
+    if (args_->model == model_name::sup) {
+      model_->setTargetCounts(dict_->getCounts(entry_type::label));
+    } else {
+      model_->setTargetCounts(dict_->getCounts(entry_type::word));
+    }
   }
 }
 
+const LoadOptions& FastText::getLoadOptions() const {
+  return loadOptions_;
+}
+
 void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
   double t = std::chrono::duration_cast<std::chrono::duration<double>> (end - start_).count();
@@ -265,9 +706,11 @@ void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
   log_stream << std::flush;
 }
 
-std::vector<int32_t> FastText::selectEmbeddings(int32_t cutoff) const {
+std::vector<int32_t> FastText::selectEmbeddings(
+    int32_t cutoff,
+    int32_t nthreads) const {
   Vector norms(input_->size(0));
-  input_->l2NormRow(norms);
+  input_->l2NormRow(norms, nthreads);
   std::vector<int32_t> idx(input_->size(0), 0);
   std::iota(idx.begin(), idx.end(), 0);
   auto eosid = dict_->getId(Dictionary::EOS);
@@ -284,21 +727,28 @@ void FastText::quantize(const Args qargs) {
     throw std::invalid_argument(
         "For now we only support quantization of supervised models");
   }
+  if (!loadOptions_.output || loadOptions_.maxWords >= 0) {
+    throw std::invalid_argument(
+        "Cannot quantize a model loaded without all of its words and "
+        "matrices.");
+  }
+  wordVectors_ = std::make_shared<Matrix>();
   args_->input = qargs.input;
   args_->qout = qargs.qout;
+  args_->saveSubwords = qargs.saveSubwords;
   args_->output = qargs.output;
 
   if (qargs.cutoff > 0 && qargs.cutoff < input_->size(0)) {
-    auto idx = selectEmbeddings(qargs.cutoff);
+    auto idx = selectEmbeddings(qargs.cutoff, qargs.thread);
     dict_->prune(idx);
-    std::shared_ptr<Matrix> ninput =
-        std::make_shared<Matrix>(idx.size(), args_->dim);
-    for (auto i = 0; i < idx.size(); i++) {
-      for (auto j = 0; j < args_->dim; j++) {
-        ninput->at(i, j) = input_->at(idx[i], j);
-      }
+    // A matrix still referenced from elsewhere, such as a NumPy view in the
+    // Python binding, is copied rather than compacted under its readers.
+    model_.reset();
+    if (input_.use_count() > 1) {
+      input_ = std::make_shared<Matrix>(*input_);
     }
-    input_ = ninput;
+    // prune sorts idx, which lets the selected rows be compacted in place.
+    input_->keepRows(idx, qargs.thread);
     if (qargs.retrain) {
       args_->epoch = qargs.epoch;
       args_->lr = qargs.lr;
@@ -308,10 +758,12 @@ void FastText::quantize(const Args qargs) {
     }
   }
 
-  qinput_ = std::make_shared<QMatrix>(*input_, qargs.dsub, qargs.qnorm);
+  qinput_ = std::make_shared<QMatrix>(
+      *input_, qargs.dsub, qargs.qnorm, qargs.nbits, qargs.opq, qargs.thread);
 
   if (args_->qout) {
-    qoutput_ = std::make_shared<QMatrix>(*output_, 2, qargs.qnorm);
+    qoutput_ = std::make_shared<QMatrix>(
+        *output_, 2, qargs.qnorm, qargs.nbits, qargs.opq, qargs.thread);
   }
 
   quant_ = true;
@@ -370,16 +822,20 @@ void FastText::skipgram(Model& model, real lr,
 std::tuple<int64_t, double, double> FastText::test(
     std::istream& in,
     int32_t k,
-    real threshold) {
+    real threshold) const {
   int32_t nexamples = 0, nlabels = 0, npredictions = 0;
   double precision = 0.0;
-  std::vector<int32_t> line, labels;
+  PredictContext ctx(*this);
 
   while (in.peek() != EOF) {
-    dict_->getLine(in, line, labels);
-    if (labels.size() > 0 && line.size() > 0) {
-      std::vector<std::pair<real, int32_t>> modelPredictions;
-      model_->predict(line, k, threshold, modelPredictions);
+    dict_->getLine(in, ctx.words, ctx.labels, ctx.wordHashes, ctx.token);
+    const std::vector<int32_t>& labels = ctx.labels;
+    if (labels.size() > 0 && ctx.words.size() > 0) {
+      std::vector<std::pair<real, int32_t>>& modelPredictions =
+          ctx.modelPredictions;
+      modelPredictions.clear();
+      model_->predict(ctx.words, k, threshold, modelPredictions,
+                      ctx.hidden, ctx.output, ctx.table);
       for (auto it = modelPredictions.cbegin(); it != modelPredictions.cend(); it++) {
         if (std::find(labels.begin(), labels.end(), it->second) != labels.end()) {
           precision += 1.0;
@@ -394,22 +850,114 @@ std::tuple<int64_t, double, double> FastText::test(
       nexamples, precision / npredictions, precision / nlabels);
 }
 
+PredictContext::PredictContext(const FastText& fasttext)
+    : hidden(fasttext.getDimension()),
+      output(fasttext.getDictionary()->nlabels()) {
+  if (!fasttext.getLoadOptions().output) {
+    throw std::invalid_argument(
+        "Cannot predict with a model loaded without its output matrix.");
+  }
+}
+
 void FastText::predict(
   std::istream& in,
   int32_t k,
   std::vector<std::pair<real,std::string>>& predictions,
   real threshold
 ) const {
-  std::vector<int32_t> words, labels;
-  predictions.clear();
-  dict_->getLine(in, words, labels);
+  PredictContext ctx(*this);
+  predict(in, k, predictions, ctx, threshold);
+}
+
+void FastText::predict(
+  std::istream& in,
+  int32_t k,
+  std::vector<std::pair<real,std::string>>& predictions,
+  PredictContext& ctx,
+  real threshold
+) const {
+  dict_->getLine(in, ctx.words, ctx.labels, ctx.wordHashes, ctx.token);
+  predictLine(k, predictions, ctx, threshold);
+}
+
+void FastText::predict(
+  const char* text,
+  size_t length,
+  int32_t k,
+  std::vector<std::pair<real,std::string>>& predictions,
+  PredictContext& ctx,
+  real threshold
+) const {
+  dict_->getLine(
+      text, length, ctx.words, ctx.labels, ctx.wordHashes, ctx.token);
+  predictLine(k, predictions, ctx, threshold);
+}
+
+void FastText::predict(
+  const std::vector<std::string>& tokens,
+  int32_t k,
+  std::vector<std::pair<real,std::string>>& predictions,
+  PredictContext& ctx,
+  real threshold
+) const {
+  dict_->getLine(tokens, ctx.words, ctx.labels, ctx.wordHashes);
+  predictLine(k, predictions, ctx, threshold);
+}
+
+// Predicts the k most likely labels of every line, spreading the lines over
+// nthreads threads. Row i of the lines.size() x k arrays labels and probs
+// receives the label ids and probabilities of lines[i], most likely first;
+// the slots left when fewer labels pass the threshold hold -1 and 0.
+void FastText::predictBatch(
+  const std::vector<std::string>& lines,
+  int32_t k,
+  real threshold,
+  int32_t* labels,
+  real* probs,
+  int32_t nthreads
+) const {
+  // Model::predict would throw from the worker threads.
+  if (k <= 0) {
+    throw std::invalid_argument("k needs to be 1 or higher!");
+  }
+  if (args_->model != model_name::sup) {
+    throw std::invalid_argument("Model needs to be supervised for prediction!");
+  }
+  utils::parallelFor(0, lines.size(), nthreads, [&](int64_t begin, int64_t end) {
+    PredictContext ctx(*this);
+    for (int64_t i = begin; i < end; i++) {
+      int32_t* lineLabels = labels + i * k;
+      real* lineProbs = probs + i * k;
+      std::fill(lineLabels, lineLabels + k, -1);
+      std::fill(lineProbs, lineProbs + k, 0.0);
+      const std::string& line = lines[i];
+      dict_->getLine(line.data(), line.size(), ctx.words, ctx.labels,
+                     ctx.wordHashes, ctx.token);
+      if (ctx.words.empty()) continue;
+      ctx.modelPredictions.clear();
+      model_->predict(ctx.words, k, threshold, ctx.modelPredictions,
+                      ctx.hidden, ctx.output, ctx.table);
+      for (size_t j = 0; j < ctx.modelPredictions.size(); j++) {
+        lineLabels[j] = ctx.modelPredictions[j].second;
+        lineProbs[j] = std::exp(ctx.modelPredictions[j].first);
+      }
+    }
+  });
+}
+
+// Predicts the labels of the line that was read into ctx.words.
+void FastText::predictLine(
+  int32_t k,
+  std::vector<std::pair<real,std::string>>& predictions,
+  PredictContext& ctx,
+  real threshold
+) const {
   predictions.clear();
-  if (words.empty()) return;
-  Vector hidden(args_->dim);
-  Vector output(dict_->nlabels());
-  std::vector<std::pair<real,int32_t>> modelPredictions;
-  model_->predict(words, k, threshold, modelPredictions, hidden, output);
-  for (auto it = modelPredictions.cbegin(); it != modelPredictions.cend(); it++) {
+  if (ctx.words.empty()) return;
+  ctx.modelPredictions.clear();
+  model_->predict(ctx.words, k, threshold, ctx.modelPredictions,
+                  ctx.hidden, ctx.output, ctx.table);
+  for (auto it = ctx.modelPredictions.cbegin(); it != ctx.modelPredictions.cend(); it++) {
     predictions.push_back(std::make_pair(it->first, dict_->getLabel(it->second)));
   }
 }
@@ -419,11 +967,12 @@ void FastText::predict(
   int32_t k,
   bool print_prob,
   real threshold
-) {
+) const {
   std::vector<std::pair<real,std::string>> predictions;
+  PredictContext ctx(*this);
   while (in.peek() != EOF) {
     predictions.clear();
-    predict(in, k, predictions, threshold);
+    predict(in, k, predictions, ctx, threshold);
     if (predictions.empty()) {
       std::cout << std::endl;
       continue;
@@ -443,36 +992,100 @@ void FastText::predict(
 
 void FastText::getSentenceVector(
     std::istream& in,
-    fasttext::Vector& svec) {
-  svec.zero();
+    fasttext::Vector& svec) const {
   if (args_->model == model_name::sup) {
     std::vector<int32_t> line, labels;
     dict_->getLine(in, line, labels);
-    for (int32_t i = 0; i < line.size(); i++) {
-      addInputVector(svec, line[i]);
-    }
-    if (!line.empty()) {
-      svec.mul(1.0 / line.size());
-    }
+    averageInputVectors(svec, line);
   } else {
-    Vector vec(args_->dim);
     std::string sentence;
     std::getline(in, sentence);
     std::istringstream iss(sentence);
+    std::vector<std::string> words;
     std::string word;
-    int32_t count = 0;
     while (iss >> word) {
-      getWordVector(vec, word);
-      real norm = vec.norm();
-      if (norm > 0) {
-        vec.mul(1.0 / norm);
-        svec.addVector(vec);
-        count++;
-      }
+      words.push_back(word);
+    }
+    averageWordVectors(svec, words);
+  }
+}
+
+void FastText::getSentenceVector(
+    const char* text,
+    size_t length,
+    fasttext::Vector& svec) const {
+  if (args_->model == model_name::sup) {
+    std::vector<int32_t> line, labels, hashes;
+    std::string token;
+    dict_->getLine(text, length, line, labels, hashes, token);
+    averageInputVectors(svec, line);
+  } else {
+    const char* end = text + length;
+    std::vector<std::string> words;
+    std::string word;
+    while (dict_->readWord(text, end, word) && word != Dictionary::EOS) {
+      words.push_back(word);
     }
-    if (count > 0) {
-      svec.mul(1.0 / count);
+    averageWordVectors(svec, words);
+  }
+}
+
+void FastText::getSentenceVector(
+    const std::vector<std::string>& tokens,
+    fasttext::Vector& svec) const {
+  if (args_->model == model_name::sup) {
+    std::vector<int32_t> line, labels, hashes;
+    dict_->getLine(tokens, line, labels, hashes);
+    averageInputVectors(svec, line);
+  } else {
+    averageWordVectors(svec, tokens);
+  }
+}
+
+// Same as getWordVectors, one row per line of text.
+void FastText::getSentenceVectors(
+    const std::vector<std::string>& lines,
+    real* out,
+    int32_t nthreads) const {
+  int64_t dim = args_->dim;
+  utils::parallelFor(0, lines.size(), nthreads, [&](int64_t begin, int64_t end) {
+    Vector svec(dim);
+    for (int64_t i = begin; i < end; i++) {
+      getSentenceVector(lines[i].data(), lines[i].size(), svec);
+      std::copy(svec.data(), svec.data() + dim, out + i * dim);
     }
+  });
+}
+
+void FastText::averageInputVectors(
+    Vector& svec,
+    const std::vector<int32_t>& line) const {
+  svec.zero();
+  addInputVectors(svec, line);
+  if (!line.empty()) {
+    svec.mul(1.0 / line.size());
+  }
+}
+
+// Averages the unit-normalized vectors of the words, skipping the ones
+// whose vector is zero.
+void FastText::averageWordVectors(
+    Vector& svec,
+    const std::vector<std::string>& words) const {
+  Vector vec(args_->dim);
+  int32_t count = 0;
+  svec.zero();
+  for (const auto& word : words) {
+    getWordVector(vec, word);
+    real norm = vec.norm();
+    if (norm > 0) {
+      vec.mul(1.0 / norm);
+      svec.addVector(vec);
+      count++;
+    }
+  }
+  if (count > 0) {
+    svec.mul(1.0 / count);
   }
 }
 
@@ -494,17 +1107,42 @@ void FastText::ngramVectors(std::string word) {
   }
 }
 
-void FastText::precomputeWordVectors(Matrix& wordVectors) {
-  Vector vec(args_->dim);
+// Stores the vectors of the n most frequent words, or of all of them if n is
+// negative, so that getWordVector copies them instead of averaging their
+// subwords. n = 0 drops the table. The table is saved with the model.
+void FastText::precomputeWordVectorTable(int32_t n, int32_t nthreads) {
+  if (n < 0 || n > dict_->nwords()) {
+    n = dict_->nwords();
+  }
+  auto table = std::make_shared<Matrix>(n, args_->dim);
+  utils::parallelFor(0, n, nthreads, [&](int64_t begin, int64_t end) {
+    Vector vec(args_->dim);
+    for (int64_t i = begin; i < end; i++) {
+      averageInputVectors(vec, dict_->getSubwords(i));
+      std::copy(vec.data(), vec.data() + args_->dim, table->data() + i * args_->dim);
+    }
+  });
+  wordVectors_ = table;
+}
+
+int32_t FastText::getWordVectorTableSize() const {
+  return wordVectors_->rows();
+}
+
+void FastText::precomputeWordVectors(Matrix& wordVectors, int32_t nthreads)
+    const {
   wordVectors.zero();
-  for (int32_t i = 0; i < dict_->nwords(); i++) {
-    std::string word = dict_->getWord(i);
-    getWordVector(vec, word);
-    real norm = vec.norm();
-    if (norm > 0) {
-      wordVectors.addRow(vec, i, 1.0 / norm);
+  utils::parallelFor(0, dict_->nwords(), nthreads, [&](int64_t begin, int64_t end) {
+    Vector vec(args_->dim);
+    for (int64_t i = begin; i < end; i++) {
+      std::string word = dict_->getWord(i);
+      getWordVector(vec, word);
+      real norm = vec.norm();
+      if (norm > 0) {
+        wordVectors.addRow(vec, i, 1.0 / norm);
+      }
     }
-  }
+  });
 }
 
 void FastText::findNN(
@@ -536,11 +1174,104 @@ void FastText::findNN(
   }
 }
 
+// For each row q of queries, writes the ids of the k rows of wordVectors
+// (as filled by precomputeWordVectors) that are the most similar to it to
+// ids[q * k, (q + 1) * k), and the similarities to scores, skipping the
+// row exclude[q] (-1 for none). Missing neighbours are padded with -1, 0.
+void FastText::findNNBatch(
+    const Matrix& wordVectors,
+    const Matrix& queries,
+    int32_t k,
+    const std::vector<int32_t>& exclude,
+    int32_t* ids,
+    real* scores,
+    int32_t nthreads) const {
+  if (k <= 0) {
+    throw std::invalid_argument("k needs to be 1 or higher!");
+  }
+  const int64_t dim = queries.cols();
+  const int64_t nwords = wordVectors.rows();
+  typedef std::pair<real, int32_t> Neighbour;
+  utils::parallelFor(0, queries.rows(), nthreads, [&](int64_t begin, int64_t end) {
+    // Each group of queries is transposed into sub-blocks of dim x lanes,
+    // so that a word row is scored against all the lanes at once.
+    std::vector<real> block(NN_QUERY_BLOCK * dim);
+    std::vector<real> norms(NN_QUERY_BLOCK);
+    std::vector<std::vector<Neighbour>> heaps(NN_QUERY_BLOCK);
+    for (int64_t q0 = begin; q0 < end; q0 += NN_QUERY_BLOCK) {
+      int64_t nq = std::min(NN_QUERY_BLOCK, end - q0);
+      std::fill(block.begin(), block.end(), 0.0);
+      for (int64_t q = 0; q < nq; q++) {
+        real* lanes = block.data() + (q / NN_QUERY_LANES) * dim * NN_QUERY_LANES;
+        real norm = 0;
+        for (int64_t j = 0; j < dim; j++) {
+          lanes[j * NN_QUERY_LANES + q % NN_QUERY_LANES] = queries.at(q0 + q, j);
+          norm += queries.at(q0 + q, j) * queries.at(q0 + q, j);
+        }
+        norm = std::sqrt(norm);
+        norms[q] = std::abs(norm) < 1e-8 ? 1 : norm;
+        heaps[q].clear();
+      }
+      for (int64_t w0 = 0; w0 < nwords; w0 += NN_WORD_BLOCK) {
+        int64_t w1 = std::min(nwords, w0 + NN_WORD_BLOCK);
+        for (int64_t l0 = 0; l0 < nq; l0 += NN_QUERY_LANES) {
+          const real* lanes = block.data() + l0 * dim;
+          int64_t nl = std::min(NN_QUERY_LANES, nq - l0);
+          // Four word rows at a time give each lane four independent
+          // chains of multiply-adds; the last row is repeated at the tail.
+          for (int64_t w = w0; w < w1; w += NN_WORD_STEP) {
+            const real* rows[NN_WORD_STEP];
+            for (int64_t i = 0; i < NN_WORD_STEP; i++) {
+              rows[i] = wordVectors.data() + std::min(w + i, w1 - 1) * dim;
+            }
+            real dot[NN_WORD_STEP][NN_QUERY_LANES] = {{0}};
+            for (int64_t j = 0; j < dim; j++) {
+              const real* lane = lanes + j * NN_QUERY_LANES;
+              for (int64_t l = 0; l < NN_QUERY_LANES; l++) {
+                for (int64_t i = 0; i < NN_WORD_STEP; i++) {
+                  dot[i][l] += lane[l] * rows[i][j];
+                }
+              }
+            }
+            for (int64_t i = 0; i < NN_WORD_STEP && w + i < w1; i++) {
+              for (int64_t l = 0; l < nl; l++) {
+                std::vector<Neighbour>& heap = heaps[l0 + l];
+                real score = dot[i][l] / norms[l0 + l];
+                if (w + i == exclude[q0 + l0 + l] ||
+                    (heap.size() == k && score <= heap.front().first)) {
+                  continue;
+                }
+                if (heap.size() == k) {
+                  std::pop_heap(
+                      heap.begin(), heap.end(), std::greater<Neighbour>());
+                  heap.pop_back();
+                }
+                heap.emplace_back(score, w + i);
+                std::push_heap(
+                    heap.begin(), heap.end(), std::greater<Neighbour>());
+              }
+            }
+          }
+        }
+      }
+      for (int64_t q = 0; q < nq; q++) {
+        std::vector<Neighbour>& heap = heaps[q];
+        std::sort_heap(heap.begin(), heap.end(), std::greater<Neighbour>());
+        for (int64_t j = 0; j < k; j++) {
+          bool found = j < heap.size();
+          ids[(q0 + q) * k + j] = found ? heap[j].second : -1;
+          scores[(q0 + q) * k + j] = found ? heap[j].first : 0.0;
+        }
+      }
+    }
+  });
+}
+
 void FastText::analogies(int32_t k) {
   std::string word;
   Vector buffer(args_->dim), query(args_->dim);
   Matrix wordVectors(dict_->nwords(), args_->dim);
-  precomputeWordVectors(wordVectors);
+  precomputeWordVectors(wordVectors, args_->thread);
   std::set<std::string> banSet;
   std::cout << "Query triplet (A - B + C)? ";
   std::vector<std::pair<real, std::string>> results;
@@ -607,49 +1338,145 @@ void FastText::trainThread(int32_t threadId) {
   ifs.close();
 }
 
+// Initializes dict_ and input_ from pretrained vectors: a .vec text file,
+// or raw float32 rows (.f32) or a NumPy array (.npy) whose words are listed
+// one per line in the .vocab file next to it, as written by saveVectors.
+// Text is parsed by args_->thread threads in two passes: the first builds
+// the dictionary, the second writes the vectors into their rows of input_.
 void FastText::loadVectors(std::string filename) {
-  std::ifstream in(filename);
-  std::vector<std::string> words;
-  std::shared_ptr<Matrix> mat; // temp. matrix for pretrained vectors
-  int64_t n, dim;
+  bool npy = endsWith(filename, ".npy");
+  bool binary = npy || endsWith(filename, ".f32");
+  std::ifstream in(filename, std::ifstream::binary);
   if (!in.is_open()) {
     throw std::invalid_argument(filename + " cannot be opened for loading!");
   }
-  in >> n >> dim;
+  std::vector<std::string> words;
+  int64_t n, dim;
+  int64_t data;
+  if (npy) {
+    utils::readNpyHeader(in, n, dim);
+    data = in.tellg();
+  } else if (binary) {
+    dim = args_->dim;
+    int64_t size = utils::size(in);
+    if (size % (dim * sizeof(real)) != 0) {
+      throw std::invalid_argument(
+          filename + " does not hold float32 rows of dimension " +
+          std::to_string(dim) + "!");
+    }
+    n = size / (dim * sizeof(real));
+    data = 0;
+  } else {
+    in >> n >> dim;
+    in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    data = in.tellg();
+  }
+  if (!in || n < 0) {
+    throw std::invalid_argument(filename + " cannot be loaded!");
+  }
   if (dim != args_->dim) {
     throw std::invalid_argument(
         "Dimension of pretrained vectors (" + std::to_string(dim) +
         ") does not match dimension (" + std::to_string(args_->dim) + ")!");
   }
-  mat = std::make_shared<Matrix>(n, dim);
-  for (size_t i = 0; i < n; i++) {
+  if (binary) {
+    std::string vocabname =
+        filename.substr(0, filename.size() - 4) + ".vocab";
+    std::ifstream vocab(vocabname);
+    if (!vocab.is_open()) {
+      throw std::invalid_argument(
+          vocabname + " cannot be opened for loading!");
+    }
     std::string word;
-    in >> word;
-    words.push_back(word);
-    dict_->add(word);
-    for (size_t j = 0; j < dim; j++) {
-      in >> mat->at(i, j);
+    while (std::getline(vocab, word)) {
+      words.push_back(word);
     }
+  } else {
+    std::vector<std::pair<const char*, const char*>> lines;
+    forEachLineBlock(in, [&](const char* begin, const char* end) {
+      splitLines(begin, end, n - words.size(), lines);
+      for (const auto& line : lines) {
+        const char* word = skipSpaces(line.first, line.second);
+        words.emplace_back(word, skipToken(word, line.second));
+      }
+    });
+  }
+  if (words.size() != n) {
+    throw std::invalid_argument(
+        filename + " holds " + std::to_string(n) + " vectors but " +
+        std::to_string(words.size()) + " words were found!");
+  }
+  for (const auto& word : words) {
+    dict_->add(word);
   }
-  in.close();
-
   dict_->threshold(1, 0);
   dict_->init();
   input_ = std::make_shared<Matrix>(dict_->nwords()+args_->bucket, args_->dim);
   input_->uniform(1.0 / args_->dim);
 
-  for (size_t i = 0; i < n; i++) {
+  // The row of input_ of each vector, or -1 when it is skipped; when a word
+  // appears several times its last vector is kept.
+  std::vector<int64_t> rows(n, -1);
+  std::vector<bool> seen(dict_->nwords(), false);
+  for (int64_t i = n - 1; i >= 0; i--) {
     int32_t idx = dict_->getId(words[i]);
-    if (idx < 0 || idx >= dict_->nwords()) continue;
-    for (size_t j = 0; j < dim; j++) {
-      input_->at(idx, j) = mat->at(i, j);
+    if (idx < 0 || idx >= dict_->nwords() || seen[idx]) continue;
+    seen[idx] = true;
+    rows[i] = idx;
+  }
+  std::vector<std::string>().swap(words);
+
+  utils::seek(in, data);
+  if (binary) {
+    for (int64_t i = 0; i < n; i++) {
+      if (rows[i] < 0) {
+        in.ignore(dim * sizeof(real));
+      } else {
+        in.read((char*) (input_->data() + rows[i] * dim), dim * sizeof(real));
+      }
+    }
+    if (!in) {
+      throw std::invalid_argument(filename + " is truncated!");
     }
+    return;
+  }
+  int64_t line0 = 0;
+  std::atomic<int64_t> badLine(-1);
+  std::vector<std::pair<const char*, const char*>> lines;
+  forEachLineBlock(in, [&](const char* begin, const char* end) {
+    splitLines(begin, end, n - line0, lines);
+    utils::parallelFor(0, lines.size(), args_->thread,
+                       [&](int64_t lb, int64_t le) {
+      for (int64_t l = lb; l < le; l++) {
+        if (rows[line0 + l] < 0) continue;
+        real* row = input_->data() + rows[line0 + l] * dim;
+        const char* eol = lines[l].second;
+        const char* p = skipToken(skipSpaces(lines[l].first, eol), eol);
+        for (int64_t j = 0; j < dim; j++) {
+          p = skipSpaces(p, eol);
+          const char* next = utils::parseReal(p, eol, row[j]);
+          if (next == p) {
+            badLine = line0 + l;
+            break;
+          }
+          p = next;
+        }
+      }
+    });
+    line0 += lines.size();
+  });
+  if (badLine >= 0) {
+    throw std::invalid_argument(
+        filename + ": vector " + std::to_string(badLine) +
+        " does not hold " + std::to_string(dim) + " numbers!");
   }
 }
 
 void FastText::train(const Args args) {
   args_ = std::make_shared<Args>(args);
   dict_ = std::make_shared<Dictionary>(args_);
+  wordVectors_ = std::make_shared<Matrix>();
+  loadOptions_ = LoadOptions();
   if (args_->input == "-") {
     // manage expectations
     throw std::invalid_argument("Cannot use stdin for training!");
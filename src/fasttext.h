@@ -30,6 +30,43 @@
 
 namespace fasttext {
 
+class FastText;
+
+// Scratch buffers of FastText::predict. Keeping one context per thread and
+// passing it to every call makes steady-state prediction allocation free.
+// A context must not be used by two threads at the same time.
+struct PredictContext {
+  std::vector<int32_t> words;
+  std::vector<int32_t> labels;
+  std::vector<int32_t> wordHashes;
+  std::string token;
+  std::vector<std::pair<real, int32_t>> modelPredictions;
+  Vector hidden;
+  Vector output;
+  std::vector<real> table;
+
+  explicit PredictContext(const FastText&);
+};
+
+// Parts of a model file that loadModel can leave out, for deployments that
+// only use some of it. A model loaded without its output matrix cannot
+// predict, and one loaded without its output matrix or with fewer words
+// cannot be saved, quantized or trained further.
+struct LoadOptions {
+  // The output matrix is only needed by predict and test.
+  bool output = true;
+  // If not negative, only the maxWords most frequent words are kept, the
+  // others being looked up as out-of-vocabulary words.
+  int32_t maxWords = -1;
+  // The word vector table stored by precomputeWordVectorTable.
+  bool wordVectors = true;
+};
+
+// Once a model is trained or loaded, the const member functions below do
+// not modify it and can be called from many threads without locking:
+// getWordVector, getSentenceVector, predict and test keep their scratch on
+// the stack or in a caller-provided PredictContext. Training, quantizing
+// and loading must not run concurrently with anything else.
 class FastText {
  protected:
   std::shared_ptr<Args> args_;
@@ -41,6 +78,11 @@ class FastText {
   std::shared_ptr<QMatrix> qinput_;
   std::shared_ptr<QMatrix> qoutput_;
 
+  // Raw vectors of the most frequent words, see precomputeWordVectorTable.
+  std::shared_ptr<Matrix> wordVectors_;
+
+  LoadOptions loadOptions_;
+
   std::shared_ptr<Model> model_;
 
   std::atomic<int64_t> tokenCount_;
@@ -54,6 +96,16 @@ class FastText {
   int32_t version;
 
   void startThreads();
+  void predictLine(
+      int32_t,
+      std::vector<std::pair<real, std::string>>&,
+      PredictContext&,
+      real) const;
+  void averageInputVectors(Vector&, const std::vector<int32_t>&) const;
+  void averageWordVectors(Vector&, const std::vector<std::string>&) const;
+  void loadInput(std::istream&, const LoadOptions&);
+  void loadOutput(std::istream&, const LoadOptions&, bool);
+  void loadModel(std::istream&, const LoadOptions&, const std::string&);
 
  public:
   FastText();
@@ -64,8 +116,10 @@ class FastText {
     "getVector is being deprecated and replaced by getWordVector.")
   void getVector(Vector&, const std::string&) const;
   void getWordVector(Vector&, const std::string&) const;
+  void getWordVectors(const std::vector<std::string>&, real*, int32_t) const;
   void getSubwordVector(Vector&, const std::string&) const;
   void addInputVector(Vector&, int32_t) const;
+  void addInputVectors(Vector&, const std::vector<int32_t>&) const;
   inline void getInputVector(Vector& vec, int32_t ind) {
     vec.zero();
     addInputVector(vec, ind);
@@ -81,6 +135,9 @@ class FastText {
   void saveModel();
   void loadModel(std::istream&);
   void loadModel(const std::string&);
+  void loadModel(std::istream&, const LoadOptions&);
+  void loadModel(const std::string&, const LoadOptions&);
+  const LoadOptions& getLoadOptions() const;
   void printInfo(real, real, std::ostream&);
 
   void supervised(
@@ -90,24 +147,65 @@ class FastText {
       const std::vector<int32_t>&);
   void cbow(Model&, real, const std::vector<int32_t>&);
   void skipgram(Model&, real, const std::vector<int32_t>&);
-  std::vector<int32_t> selectEmbeddings(int32_t) const;
-  void getSentenceVector(std::istream&, Vector&);
+  std::vector<int32_t> selectEmbeddings(int32_t, int32_t = 1) const;
+  void getSentenceVector(std::istream&, Vector&) const;
+  void getSentenceVector(const char*, size_t, Vector&) const;
+  void getSentenceVector(const std::vector<std::string>&, Vector&) const;
+  void getSentenceVectors(const std::vector<std::string>&, real*, int32_t)
+      const;
   void quantize(const Args);
-  std::tuple<int64_t, double, double> test(std::istream&, int32_t, real = 0.0);
-  void predict(std::istream&, int32_t, bool, real = 0.0);
+  std::tuple<int64_t, double, double>
+  test(std::istream&, int32_t, real = 0.0) const;
+  void predict(std::istream&, int32_t, bool, real = 0.0) const;
   void predict(
       std::istream&,
       int32_t,
       std::vector<std::pair<real, std::string>>&,
       real = 0.0) const;
+  void predict(
+      std::istream&,
+      int32_t,
+      std::vector<std::pair<real, std::string>>&,
+      PredictContext&,
+      real = 0.0) const;
+  void predict(
+      const char*,
+      size_t,
+      int32_t,
+      std::vector<std::pair<real, std::string>>&,
+      PredictContext&,
+      real = 0.0) const;
+  void predict(
+      const std::vector<std::string>&,
+      int32_t,
+      std::vector<std::pair<real, std::string>>&,
+      PredictContext&,
+      real = 0.0) const;
+  void predictBatch(
+      const std::vector<std::string>&,
+      int32_t,
+      real,
+      int32_t*,
+      real*,
+      int32_t) const;
   void ngramVectors(std::string);
-  void precomputeWordVectors(Matrix&);
+  void precomputeWordVectorTable(int32_t, int32_t = 1);
+  int32_t getWordVectorTableSize() const;
+  void precomputeWordVectors(Matrix&, int32_t = 1) const;
   void findNN(
       const Matrix&,
       const Vector&,
       int32_t,
       const std::set<std::string>&,
       std::vector<std::pair<real, std::string>>& results);
+  void findNNBatch(
+      const Matrix&,
+      const Matrix&,
+      int32_t,
+      const std::vector<int32_t>&,
+      int32_t*,
+      real*,
+      int32_t) const;
   void analogies(int32_t);
   void trainThread(int32_t);
   void train(const Args);
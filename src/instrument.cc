@@ -0,0 +1,203 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#include "instrument.h"
+
+#ifdef FASTTEXT_INSTRUMENT
+
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+namespace fasttext {
+namespace instrument {
+
+namespace {
+
+constexpr int NPROBES = static_cast<int>(Probe::count);
+constexpr int NCOUNTERS = 2;
+
+const char* const PROBE_NAMES[NPROBES] = {
+    "getLine", "computeHidden", "loss", "updateScatter", "predict"};
+
+const char* const COUNTER_NAMES[NCOUNTERS] = {"cycles", "llc-misses"};
+
+}
+
+// Only ever written by its own thread. Instances are owned by a global
+// registry so that they survive the training threads and can be dumped.
+struct ThreadStats {
+  int64_t calls[NPROBES] = {};
+  int64_t ns[NPROBES] = {};
+  uint64_t counters[NPROBES][NCOUNTERS] = {};
+  // Group of hardware counters of the thread, -1 when unavailable.
+  int perf_fd = -1;
+  bool perf_enabled = false;
+};
+
+namespace {
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadStats>>& registry() {
+  static std::vector<std::unique_ptr<ThreadStats>> stats;
+  return stats;
+}
+
+#ifdef __linux__
+int openCounter(uint32_t type, uint64_t config, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = type;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return syscall(__NR_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+void openCounters(ThreadStats* stats) {
+  int leader = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+  if (leader < 0) {
+    return;
+  }
+  uint64_t llc = PERF_COUNT_HW_CACHE_LL |
+      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+  if (openCounter(PERF_TYPE_HW_CACHE, llc, leader) < 0) {
+    close(leader);
+    return;
+  }
+  stats->perf_fd = leader;
+  stats->perf_enabled = true;
+}
+
+void readCounters(const ThreadStats* stats, uint64_t* values) {
+  // PERF_FORMAT_GROUP layout: number of counters, then their values.
+  uint64_t buffer[1 + NCOUNTERS];
+  if (stats->perf_enabled &&
+      read(stats->perf_fd, buffer, sizeof(buffer)) == sizeof(buffer)) {
+    for (int i = 0; i < NCOUNTERS; i++) {
+      values[i] = buffer[1 + i];
+    }
+  } else {
+    for (int i = 0; i < NCOUNTERS; i++) {
+      values[i] = 0;
+    }
+  }
+}
+#else
+void openCounters(ThreadStats*) {}
+
+void readCounters(const ThreadStats*, uint64_t* values) {
+  for (int i = 0; i < NCOUNTERS; i++) {
+    values[i] = 0;
+  }
+}
+#endif
+
+ThreadStats* threadStats() {
+  static thread_local ThreadStats* stats = nullptr;
+  if (!stats) {
+    std::unique_ptr<ThreadStats> s(new ThreadStats());
+    openCounters(s.get());
+    stats = s.get();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry().push_back(std::move(s));
+  }
+  return stats;
+}
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+ScopedTimer::ScopedTimer(Probe probe)
+    : stats_(threadStats()), probe_(probe) {
+  readCounters(stats_, start_counters_);
+  start_ns_ = nowNs();
+}
+
+ScopedTimer::~ScopedTimer() {
+  int64_t end_ns = nowNs();
+  uint64_t end_counters[NCOUNTERS];
+  readCounters(stats_, end_counters);
+  int p = static_cast<int>(probe_);
+  stats_->calls[p]++;
+  stats_->ns[p] += end_ns - start_ns_;
+  for (int i = 0; i < NCOUNTERS; i++) {
+    stats_->counters[p][i] += end_counters[i] - start_counters_[i];
+  }
+}
+
+void dump(std::ostream& out) {
+  std::lock_guard<std::mutex> lock(registryMutex);
+  ThreadStats total;
+  bool perf = false;
+  for (auto& stats : registry()) {
+    perf = perf || stats->perf_enabled;
+    for (int p = 0; p < NPROBES; p++) {
+      total.calls[p] += stats->calls[p];
+      total.ns[p] += stats->ns[p];
+      for (int i = 0; i < NCOUNTERS; i++) {
+        total.counters[p][i] += stats->counters[p][i];
+      }
+    }
+    int fd = stats->perf_fd;
+    *stats = ThreadStats();
+    stats->perf_fd = fd;
+    stats->perf_enabled = fd >= 0;
+  }
+
+  out << std::endl << std::left << std::setw(16) << "probe"
+      << std::right << std::setw(14) << "calls"
+      << std::setw(14) << "total ms" << std::setw(12) << "ns/call";
+  if (perf) {
+    for (int i = 0; i < NCOUNTERS; i++) {
+      out << std::setw(16) << (std::string(COUNTER_NAMES[i]) + "/call");
+    }
+  }
+  out << std::endl << std::fixed << std::setprecision(1);
+  for (int p = 0; p < NPROBES; p++) {
+    if (total.calls[p] == 0) {
+      continue;
+    }
+    double calls = total.calls[p];
+    out << std::left << std::setw(16) << PROBE_NAMES[p]
+        << std::right << std::setw(14) << total.calls[p]
+        << std::setw(14) << total.ns[p] / 1e6
+        << std::setw(12) << total.ns[p] / calls;
+    if (perf) {
+      for (int i = 0; i < NCOUNTERS; i++) {
+        out << std::setw(16) << total.counters[p][i] / calls;
+      }
+    }
+    out << std::endl;
+  }
+  if (!perf) {
+    out << "(hardware counters unavailable)" << std::endl;
+  }
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the BSD-style license found in the
+ * LICENSE file in the root directory of this source tree. An additional grant
+ * of patent rights can be found in the PATENTS file in the same directory.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Scoped timers on the hot paths, compiled in only when FASTTEXT_INSTRUMENT
+// is defined. Otherwise FASTTEXT_PROBE expands to nothing and dump is an
+// empty inline function, so the probes can stay in release builds.
+
+namespace fasttext {
+namespace instrument {
+
+enum class Probe : int {
+  getLine = 0,
+  computeHidden,
+  loss,
+  updateScatter,
+  predict,
+  count
+};
+
+#ifdef FASTTEXT_INSTRUMENT
+
+struct ThreadStats;
+
+// Accumulates the wall time, and on Linux the cycles and last level cache
+// misses, spent in its scope into the statistics of the calling thread.
+class ScopedTimer {
+  private:
+    ThreadStats* stats_;
+    Probe probe_;
+    int64_t start_ns_;
+    uint64_t start_counters_[2];
+
+  public:
+    explicit ScopedTimer(Probe);
+    ~ScopedTimer();
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+// Prints the statistics summed over all threads, then clears them.
+void dump(std::ostream&);
+
+#define FASTTEXT_PROBE_CONCAT_(a, b) a##b
+#define FASTTEXT_PROBE_CONCAT(a, b) FASTTEXT_PROBE_CONCAT_(a, b)
+#define FASTTEXT_PROBE(probe)                                  \
+  ::fasttext::instrument::ScopedTimer FASTTEXT_PROBE_CONCAT(   \
+      fasttext_probe_, __LINE__)(::fasttext::instrument::Probe::probe)
+
+#else
+
+inline void dump(std::ostream&) {}
+
+#define FASTTEXT_PROBE(probe)
+
+#endif
+
+}
+}
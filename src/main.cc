@@ -7,15 +7,61 @@
  * of patent rights can be found in the PATENTS file in the same directory.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
+#include <new>
 #include <queue>
 #include <iomanip>
+#include <sstream>
+#include <thread>
 #include "fasttext.h"
 #include "compact_dictionary.h"
 #include "args.h"
+#include "instrument.h"
 
 using namespace fasttext;
 
+// Only the command line binary defines FASTTEXT_COUNT_ALLOCATIONS: replacing
+// the global operator new in a library, such as the Python extension which
+// also compiles this file, would affect the whole host process.
+#ifdef FASTTEXT_COUNT_ALLOCATIONS
+static thread_local int64_t threadAllocations = 0;
+
+void* operator new(size_t size) {
+  threadAllocations++;
+  void* p = std::malloc(size == 0 ? 1 : size);
+  if (!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+#endif
+
+// Number of allocations made so far by the calling thread, or -1 when they
+// are not counted.
+int64_t allocationCount() {
+#ifdef FASTTEXT_COUNT_ALLOCATIONS
+  return threadAllocations;
+#else
+  return -1;
+#endif
+}
+
+// Loads a model for commands that only use its input vectors.
+void loadModelWithoutOutput(FastText& fasttext, const std::string& path) {
+  LoadOptions options;
+  options.output = false;
+  fasttext.loadModel(path, options);
+}
+
 void printUsage() {
   std::cerr
     << "usage: fasttext <command> <args>\n\n"
@@ -31,9 +77,12 @@ void printUsage() {
     << "  print-sentence-vectors  print sentence vectors given a trained model\n"
     << "  print-ngrams            print ngrams given a trained model and word\n"
     << "  nn                      query for nearest neighbors\n"
+    << "  nn-batch                find nearest neighbors of a file of words\n"
     << "  analogies               query for analogies\n"
     << "  dump                    dump arguments,dictionary,input/output vectors\n"
     << "  generate-compact        generate a compact binary file\n"
+    << "  precompute-vectors      store word vectors in a model for serving\n"
+    << "  bench-predict           measure the inference latency of a model\n"
     << std::endl;
 }
 
@@ -65,15 +114,19 @@ void printPredictUsage() {
 
 void printPrintWordVectorsUsage() {
   std::cerr
-    << "usage: fasttext print-word-vectors <model>\n\n"
+    << "usage: fasttext print-word-vectors <model> [<format>]\n\n"
     << "  <model>      model filename\n"
+    << "  <format>     (optional; text by default) text, raw (float32 rows)\n"
+    << "               or npy\n"
     << std::endl;
 }
 
 void printPrintSentenceVectorsUsage() {
   std::cerr
-    << "usage: fasttext print-sentence-vectors <model>\n\n"
+    << "usage: fasttext print-sentence-vectors <model> [<format>]\n\n"
     << "  <model>      model filename\n"
+    << "  <format>     (optional; text by default) text, raw (float32 rows)\n"
+    << "               or npy\n"
     << std::endl;
 }
 
@@ -92,6 +145,30 @@ void printGenerateCompactUsage() {
     << std::endl;
 }
 
+void printPrecomputeVectorsUsage() {
+  std::cerr
+    << "usage: fasttext precompute-vectors <model> <output> [<n>] [<threads>]\n\n"
+    << "  <model>      model filename\n"
+    << "  <output>     output model filename\n"
+    << "  <n>          (optional; all by default) number of most frequent words\n"
+    << "               whose vectors are stored, 0 removes the stored vectors\n"
+    << "  <threads>    (optional; number of threads of the model by default)\n"
+    << std::endl;
+}
+
+void printBenchPredictUsage() {
+  std::cerr
+    << "usage: fasttext bench-predict <model> <queries> [<mode>] [<threads>] [<repeat>] [<k>]\n\n"
+    << "  <model>      model filename\n"
+    << "  <queries>    query filename, one query per line\n"
+    << "  <mode>       (optional; predict by default) predict, predict-buffer,\n"
+    << "               word-vector or sentence-vector\n"
+    << "  <threads>    (optional; 1 by default) number of concurrent clients\n"
+    << "  <repeat>     (optional; 1 by default) number of passes over the queries\n"
+    << "  <k>          (optional; 1 by default) predict top k labels\n"
+    << std::endl;
+}
+
 void quantize(const std::vector<std::string>& args) {
   Args a = Args();
   if (args.size() < 3) {
@@ -116,6 +193,16 @@ void printNNUsage() {
     << std::endl;
 }
 
+void printNNBatchUsage() {
+  std::cerr
+    << "usage: fasttext nn-batch <model> <queries> [<k>] [<threads>]\n\n"
+    << "  <model>      model filename\n"
+    << "  <queries>    query filename, whitespace separated words (if -, read from stdin)\n"
+    << "  <k>          (optional; 10 by default) number of neighbors\n"
+    << "  <threads>    (optional; number of threads of the model by default)\n"
+    << std::endl;
+}
+
 void printAnalogiesUsage() {
   std::cout
     << "usage: fasttext analogies <model> <k>\n\n"
@@ -126,12 +213,40 @@ void printAnalogiesUsage() {
 
 void printDumpUsage() {
   std::cout
-    << "usage: fasttext dump <model> <option>\n\n"
+    << "usage: fasttext dump <model> <option> [<format>]\n\n"
     << "  <model>      model filename\n"
-    << "  <option>     option from args,dict,input,output"
+    << "  <option>     option from args,dict,input,output\n"
+    << "  <format>     (optional; text by default) format of input,output:\n"
+    << "               text, raw (float32 rows) or npy"
     << std::endl;
 }
 
+// Parses the optional <format> argument of print-word-vectors,
+// print-sentence-vectors and dump; returns false if it is unknown.
+bool parseVectorFormat(const std::string& name, vector_format& format) {
+  if (name == "text") {
+    format = vector_format::text;
+  } else if (name == "raw") {
+    format = vector_format::raw;
+  } else if (name == "npy") {
+    format = vector_format::npy;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Writes the rows of vectors to stdout as raw float32 or as a .npy file.
+void writeBinaryVectors(const Matrix& vectors, vector_format format) {
+  if (format == vector_format::npy) {
+    utils::writeNpyHeader(std::cout, vectors.rows(), vectors.cols());
+  }
+  std::cout.write(
+      (const char*) vectors.data(),
+      vectors.rows() * vectors.cols() * sizeof(real));
+  std::cout.flush();
+}
+
 void test(const std::vector<std::string>& args) {
   if (args.size() < 4 || args.size() > 6) {
     printTestUsage();
@@ -162,6 +277,7 @@ void test(const std::vector<std::string>& args) {
     result = fasttext.test(ifs, k, threshold);
     ifs.close();
   }
+  instrument::dump(std::cerr);
   std::cout << "N" << "\t" << std::get<0>(result) << std::endl;
   std::cout << std::setprecision(3);
   std::cout << "P@" << k << "\t" << std::get<1>(result) << std::endl;
@@ -204,34 +320,62 @@ void predict(const std::vector<std::string>& args) {
 }
 
 void printWordVectors(const std::vector<std::string> args) {
-  if (args.size() != 3) {
+  vector_format format = vector_format::text;
+  if (args.size() < 3 || args.size() > 4 ||
+      (args.size() == 4 && !parseVectorFormat(args[3], format))) {
     printPrintWordVectorsUsage();
     exit(EXIT_FAILURE);
   }
   FastText fasttext;
-  fasttext.loadModel(std::string(args[2]));
+  loadModelWithoutOutput(fasttext, args[2]);
   std::string word;
-  Vector vec(fasttext.getDimension());
+  if (format == vector_format::text) {
+    // Answers word by word, so that it can be queried through a pipe.
+    Vector vec(fasttext.getDimension());
+    while (std::cin >> word) {
+      fasttext.getWordVector(vec, word);
+      std::cout << word << " " << vec << std::endl;
+    }
+    exit(0);
+  }
+  std::vector<std::string> words;
   while (std::cin >> word) {
-    fasttext.getWordVector(vec, word);
-    std::cout << word << " " << vec << std::endl;
+    words.push_back(word);
   }
+  Matrix vectors(words.size(), fasttext.getDimension());
+  fasttext.getWordVectors(
+      words, vectors.data(), fasttext.getArgs().thread);
+  writeBinaryVectors(vectors, format);
   exit(0);
 }
 
 void printSentenceVectors(const std::vector<std::string> args) {
-  if (args.size() != 3) {
+  vector_format format = vector_format::text;
+  if (args.size() < 3 || args.size() > 4 ||
+      (args.size() == 4 && !parseVectorFormat(args[3], format))) {
     printPrintSentenceVectorsUsage();
     exit(EXIT_FAILURE);
   }
   FastText fasttext;
-  fasttext.loadModel(std::string(args[2]));
-  Vector svec(fasttext.getDimension());
-  while (std::cin.peek() != EOF) {
-    fasttext.getSentenceVector(std::cin, svec);
-    // Don't print sentence
-    std::cout << svec << std::endl;
+  loadModelWithoutOutput(fasttext, args[2]);
+  if (format == vector_format::text) {
+    Vector svec(fasttext.getDimension());
+    while (std::cin.peek() != EOF) {
+      fasttext.getSentenceVector(std::cin, svec);
+      // Don't print sentence
+      std::cout << svec << std::endl;
+    }
+    exit(0);
+  }
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    lines.push_back(line + "\n");
   }
+  Matrix vectors(lines.size(), fasttext.getDimension());
+  fasttext.getSentenceVectors(
+      lines, vectors.data(), fasttext.getArgs().thread);
+  writeBinaryVectors(vectors, format);
   exit(0);
 }
 
@@ -241,7 +385,7 @@ void printNgrams(const std::vector<std::string> args) {
     exit(EXIT_FAILURE);
   }
   FastText fasttext;
-  fasttext.loadModel(std::string(args[2]));
+  loadModelWithoutOutput(fasttext, args[2]);
   fasttext.ngramVectors(std::string(args[3]));
   exit(0);
 }
@@ -262,6 +406,20 @@ void generateCompact(const std::vector<std::string> args) {
   exit(0);
 }
 
+void precomputeVectors(const std::vector<std::string>& args) {
+  if (args.size() < 4 || args.size() > 6) {
+    printPrecomputeVectorsUsage();
+    exit(EXIT_FAILURE);
+  }
+  FastText fasttext;
+  fasttext.loadModel(args[2]);
+  int32_t n = args.size() > 4 ? std::stoi(args[4]) : -1;
+  int32_t nthreads =
+      args.size() > 5 ? std::stoi(args[5]) : fasttext.getArgs().thread;
+  fasttext.precomputeWordVectorTable(n, nthreads);
+  fasttext.saveModel(args[3]);
+}
+
 void nn(const std::vector<std::string> args) {
   int32_t k;
   if (args.size() == 3) {
@@ -273,13 +431,13 @@ void nn(const std::vector<std::string> args) {
     exit(EXIT_FAILURE);
   }
   FastText fasttext;
-  fasttext.loadModel(std::string(args[2]));
+  loadModelWithoutOutput(fasttext, args[2]);
   std::string queryWord;
   std::shared_ptr<const Dictionary> dict = fasttext.getDictionary();
   Vector queryVec(fasttext.getDimension());
   Matrix wordVectors(dict->nwords(), fasttext.getDimension());
   std::cerr << "Pre-computing word vectors...";
-  fasttext.precomputeWordVectors(wordVectors);
+  fasttext.precomputeWordVectors(wordVectors, fasttext.getArgs().thread);
   std::cerr << " done." << std::endl;
   std::set<std::string> banSet;
   std::cout << "Query word? ";
@@ -297,6 +455,74 @@ void nn(const std::vector<std::string> args) {
   exit(0);
 }
 
+// Prints one line per query word: the word, then its k nearest
+// neighbors each followed by its similarity.
+void nnBatch(const std::vector<std::string> args) {
+  if (args.size() < 4 || args.size() > 6) {
+    printNNBatchUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t k = args.size() > 4 ? std::stoi(args[4]) : 10;
+  FastText fasttext;
+  loadModelWithoutOutput(fasttext, args[2]);
+  int32_t nthreads =
+      args.size() > 5 ? std::stoi(args[5]) : fasttext.getArgs().thread;
+  if (k <= 0 || nthreads <= 0) {
+    printNNBatchUsage();
+    exit(EXIT_FAILURE);
+  }
+  std::ifstream ifs;
+  if (args[3] != "-") {
+    ifs.open(args[3]);
+    if (!ifs.is_open()) {
+      std::cerr << "Queries file cannot be opened!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  std::istream& in = args[3] == "-" ? std::cin : ifs;
+  std::shared_ptr<const Dictionary> dict = fasttext.getDictionary();
+  int32_t dim = fasttext.getDimension();
+  Matrix wordVectors(dict->nwords(), dim);
+  fasttext.precomputeWordVectors(wordVectors, nthreads);
+
+  const size_t chunkSize = 65536;
+  std::vector<std::string> words;
+  std::vector<int32_t> exclude, ids;
+  std::vector<real> scores;
+  std::string word;
+  char buffer[32];
+  while (in.peek() != EOF) {
+    words.clear();
+    while (words.size() < chunkSize && in >> word) {
+      words.push_back(word);
+    }
+    Matrix queries(words.size(), dim);
+    fasttext.getWordVectors(words, queries.data(), nthreads);
+    exclude.resize(words.size());
+    for (size_t i = 0; i < words.size(); i++) {
+      int32_t id = dict->getId(words[i]);
+      exclude[i] = id < dict->nwords() ? id : -1;
+    }
+    ids.resize(words.size() * k);
+    scores.resize(words.size() * k);
+    fasttext.findNNBatch(
+        wordVectors, queries, k, exclude, ids.data(), scores.data(), nthreads);
+    std::string line;
+    for (size_t i = 0; i < words.size(); i++) {
+      line = words[i];
+      for (int32_t j = 0; j < k && ids[i * k + j] >= 0; j++) {
+        line += ' ';
+        line += dict->getWord(ids[i * k + j]);
+        line += ' ';
+        line.append(buffer, utils::formatReal(scores[i * k + j], 6, buffer));
+      }
+      line += '\n';
+      std::cout << line;
+    }
+  }
+  exit(0);
+}
+
 void analogies(const std::vector<std::string> args) {
   int32_t k;
   if (args.size() == 3) {
@@ -308,7 +534,7 @@ void analogies(const std::vector<std::string> args) {
     exit(EXIT_FAILURE);
   }
   FastText fasttext;
-  fasttext.loadModel(std::string(args[2]));
+  loadModelWithoutOutput(fasttext, args[2]);
   fasttext.analogies(k);
   exit(0);
 }
@@ -323,6 +549,7 @@ void train(const std::vector<std::string> args) {
   }
   ofs.close();
   fasttext.train(a);
+  instrument::dump(std::cerr);
   fasttext.saveModel();
   fasttext.saveVectors();
   if (a.saveOutput) {
@@ -331,7 +558,9 @@ void train(const std::vector<std::string> args) {
 }
 
 void dump(const std::vector<std::string>& args) {
-  if (args.size() < 4) {
+  vector_format format = vector_format::text;
+  if (args.size() < 4 || args.size() > 5 ||
+      (args.size() == 5 && !parseVectorFormat(args[4], format))) {
     printDumpUsage();
     exit(EXIT_FAILURE);
   }
@@ -345,17 +574,18 @@ void dump(const std::vector<std::string>& args) {
     fasttext.getArgs().dump(std::cout);
   } else if (option == "dict") {
     fasttext.getDictionary()->dump(std::cout);
-  } else if (option == "input") {
+  } else if (option == "input" || option == "output") {
     if (fasttext.isQuant()) {
       std::cerr << "Not supported for quantized models." << std::endl;
-    } else {
-      fasttext.getInputMatrix()->dump(std::cout);
+      return;
     }
-  } else if (option == "output") {
-    if (fasttext.isQuant()) {
-      std::cerr << "Not supported for quantized models." << std::endl;
+    std::shared_ptr<const Matrix> matrix = option == "input"
+        ? fasttext.getInputMatrix()
+        : fasttext.getOutputMatrix();
+    if (format == vector_format::text) {
+      matrix->dump(std::cout);
     } else {
-      fasttext.getOutputMatrix()->dump(std::cout);
+      writeBinaryVectors(*matrix, format);
     }
   } else {
     printDumpUsage();
@@ -363,6 +593,141 @@ void dump(const std::vector<std::string>& args) {
   }
 }
 
+// Nearest-rank percentile of sorted latencies.
+int64_t percentile(const std::vector<int64_t>& sorted, double p) {
+  int64_t rank = std::ceil(p * sorted.size());
+  return sorted[std::max<int64_t>(rank, 1) - 1];
+}
+
+void benchPredict(const std::vector<std::string>& args) {
+  if (args.size() < 4 || args.size() > 8) {
+    printBenchPredictUsage();
+    exit(EXIT_FAILURE);
+  }
+  std::string mode = args.size() > 4 ? args[4] : "predict";
+  int32_t nthreads = args.size() > 5 ? std::stoi(args[5]) : 1;
+  int32_t repeat = args.size() > 6 ? std::stoi(args[6]) : 1;
+  int32_t k = args.size() > 7 ? std::stoi(args[7]) : 1;
+  if ((mode != "predict" && mode != "predict-buffer" &&
+       mode != "word-vector" && mode != "sentence-vector") || nthreads < 1 || repeat < 1) {
+    printBenchPredictUsage();
+    exit(EXIT_FAILURE);
+  }
+
+  FastText fasttext;
+  fasttext.loadModel(std::string(args[2]));
+  std::ifstream ifs(args[3]);
+  if (!ifs.is_open()) {
+    std::cerr << "Query file cannot be opened!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // Word vectors are queried for every word of the file, the other modes
+  // take one query per line.
+  std::vector<std::string> queries;
+  std::string query;
+  if (mode == "word-vector") {
+    while (ifs >> query) {
+      queries.push_back(query);
+    }
+  } else {
+    while (std::getline(ifs, query)) {
+      queries.push_back(query + "\n");
+    }
+  }
+  ifs.close();
+  if (queries.empty()) {
+    std::cerr << "No queries!" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Runs one query and returns its latency in nanoseconds, adding the heap
+  // allocations it made to allocs. The input stream is reused across queries
+  // so that refilling it does not allocate once its buffer has grown.
+  auto run = [&](const std::string& query, std::istringstream& in, Vector& vec,
+                 std::vector<std::pair<real, std::string>>& predictions,
+                 PredictContext& ctx, int64_t& allocs) {
+    in.str(query);
+    in.clear();
+    int64_t before = allocationCount();
+    auto start = std::chrono::steady_clock::now();
+    if (mode == "predict") {
+      fasttext.predict(in, k, predictions, ctx);
+    } else if (mode == "predict-buffer") {
+      fasttext.predict(query.data(), query.size(), k, predictions, ctx);
+    } else if (mode == "word-vector") {
+      fasttext.getWordVector(vec, query);
+    } else {
+      fasttext.getSentenceVector(in, vec);
+    }
+    auto end = std::chrono::steady_clock::now();
+    allocs += allocationCount() - before;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        end - start).count();
+  };
+
+  int64_t total = int64_t(queries.size()) * repeat;
+  std::atomic<int64_t> next(0);
+  std::vector<std::vector<int64_t>> latencies(nthreads);
+  std::vector<int64_t> allocations(nthreads, 0);
+  auto client = [&](int32_t t) {
+    std::istringstream in;
+    Vector vec(fasttext.getDimension());
+    std::vector<std::pair<real, std::string>> predictions;
+    PredictContext ctx(fasttext);
+    // Warm up caches, allocator and scratch buffers before measuring.
+    int64_t warmupAllocs = 0;
+    for (size_t i = 0; i < std::min<size_t>(queries.size(), 100); i++) {
+      run(queries[i], in, vec, predictions, ctx, warmupAllocs);
+    }
+    latencies[t].reserve(total / nthreads + 1);
+    int64_t i;
+    while ((i = next++) < total) {
+      const std::string& query = queries[i % queries.size()];
+      latencies[t].push_back(
+          run(query, in, vec, predictions, ctx, allocations[t]));
+    }
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < nthreads; t++) {
+    threads.push_back(std::thread(client, t));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+
+  std::vector<int64_t> all;
+  all.reserve(total);
+  int64_t nallocations = 0;
+  for (int32_t t = 0; t < nthreads; t++) {
+    all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+    nallocations += allocations[t];
+  }
+  std::sort(all.begin(), all.end());
+
+  std::cout << "mode\t" << mode << std::endl;
+  std::cout << "threads\t" << nthreads << std::endl;
+  std::cout << "queries\t" << total << std::endl;
+  std::cout << std::fixed << std::setprecision(1);
+  std::cout << "qps\t" << total / elapsed << std::endl;
+  std::cout << std::setprecision(2);
+  std::cout << "p50_us\t" << percentile(all, 0.5) / 1e3 << std::endl;
+  std::cout << "p90_us\t" << percentile(all, 0.9) / 1e3 << std::endl;
+  std::cout << "p99_us\t" << percentile(all, 0.99) / 1e3 << std::endl;
+  std::cout << "p99.9_us\t" << percentile(all, 0.999) / 1e3 << std::endl;
+  std::cout << "max_us\t" << all.back() / 1e3 << std::endl;
+  if (allocationCount() >= 0) {
+    std::cout << "allocs_per_query\t" << double(nallocations) / total
+              << std::endl;
+  } else {
+    std::cout << "allocs_per_query\tn/a" << std::endl;
+  }
+  exit(0);
+}
+
 int main(int argc, char** argv) {
   std::vector<std::string> args(argv, argv + argc);
   if (args.size() < 2) {
@@ -384,6 +749,8 @@ int main(int argc, char** argv) {
     printNgrams(args);
   } else if (command == "nn") {
     nn(args);
+  } else if (command == "nn-batch") {
+    nnBatch(args);
   } else if (command == "analogies") {
     analogies(args);
   } else if (command == "predict" || command == "predict-prob") {
@@ -392,6 +759,10 @@ int main(int argc, char** argv) {
     dump(args);
   } else if (command == "generate-compact") {
     generateCompact(args);
+  } else if (command == "precompute-vectors") {
+    precomputeVectors(args);
+  } else if (command == "bench-predict") {
+    benchPredict(args);
   } else {
     printUsage();
     exit(EXIT_FAILURE);
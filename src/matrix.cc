@@ -9,15 +9,20 @@
 
 #include "matrix.h"
 
+#include <algorithm>
+#include <cstring>
 #include <random>
 #include <exception>
 #include <stdexcept>
+#include <string>
 
 #include "utils.h"
 #include "vector.h"
 
 namespace fasttext {
 
+constexpr int64_t KEEP_ROWS_BLOCK_SIZE = 1 << 16;
+
 Matrix::Matrix() : Matrix(0, 0) {}
 
 Matrix::Matrix(int64_t m, int64_t n) : data_(m * n), m_(m), n_(n) {}
@@ -72,19 +77,25 @@ void Matrix::multiplyRow(const Vector& nums, int64_t ib, int64_t ie) {
   }
 }
 
-void Matrix::divideRow(const Vector& denoms, int64_t ib, int64_t ie) {
+void Matrix::divideRow(
+    const Vector& denoms,
+    int64_t ib,
+    int64_t ie,
+    int32_t nthreads) {
   if (ie == -1) {
     ie = m_;
   }
   assert(ie <= denoms.size());
-  for (auto i = ib; i < ie; i++) {
-    real n = denoms[i - ib];
-    if (n != 0) {
-      for (auto j = 0; j < n_; j++) {
-        at(i, j) /= n;
+  utils::parallelFor(ib, ie, nthreads, [&](int64_t b, int64_t e) {
+    for (auto i = b; i < e; i++) {
+      real n = denoms[i - ib];
+      if (n != 0) {
+        for (auto j = 0; j < n_; j++) {
+          at(i, j) /= n;
+        }
       }
     }
-  }
+  });
 }
 
 real Matrix::l2NormRow(int64_t i) const {
@@ -98,11 +109,47 @@ real Matrix::l2NormRow(int64_t i) const {
   return std::sqrt(norm);
 }
 
-void Matrix::l2NormRow(Vector& norms) const {
+void Matrix::l2NormRow(Vector& norms, int32_t nthreads) const {
   assert(norms.size() == m_);
-  for (auto i = 0; i < m_; i++) {
-    norms[i] = l2NormRow(i);
+  utils::parallelFor(0, m_, nthreads, [&](int64_t b, int64_t e) {
+    for (auto i = b; i < e; i++) {
+      norms[i] = l2NormRow(i);
+    }
+  });
+}
+
+void Matrix::keepRows(const std::vector<int32_t>& idx, int32_t nthreads) {
+  int64_t m = idx.size();
+  for (int64_t i = 0; i < m; i++) {
+    if (idx[i] < 0 || idx[i] >= m_ || (i > 0 && idx[i] <= idx[i - 1])) {
+      throw std::invalid_argument(
+          "Row indices must be strictly increasing and within the matrix");
+    }
+  }
+  // Since idx[i] >= i, the rows of a block only come from that block or
+  // from later ones: they are gathered into a staging buffer first, so
+  // that threads never read rows that are being overwritten.
+  int64_t bsize = std::min(m, KEEP_ROWS_BLOCK_SIZE);
+  std::vector<real> staging(bsize * n_);
+  for (int64_t b = 0; b < m; b += bsize) {
+    int64_t e = std::min(m, b + bsize);
+    utils::parallelFor(b, e, nthreads, [&](int64_t rb, int64_t re) {
+      for (auto i = rb; i < re; i++) {
+        memcpy(
+            staging.data() + (i - b) * n_,
+            data_.data() + idx[i] * n_,
+            n_ * sizeof(real));
+      }
+    });
+    memcpy(
+        data_.data() + b * n_,
+        staging.data(),
+        (e - b) * n_ * sizeof(real));
   }
+  staging = std::vector<real>();
+  m_ = m;
+  data_.resize(m_ * n_);
+  data_.shrink_to_fit();
 }
 
 void Matrix::save(std::ostream& out) {
@@ -118,17 +165,38 @@ void Matrix::load(std::istream& in) {
   in.read((char*)data_.data(), m_ * n_ * sizeof(real));
 }
 
+// Loads only the first head and the last tail rows of the saved matrix,
+// seeking over the others.
+void Matrix::load(std::istream& in, int64_t head, int64_t tail) {
+  int64_t m;
+  in.read((char*)&m, sizeof(int64_t));
+  in.read((char*)&n_, sizeof(int64_t));
+  head = std::min(head, m);
+  tail = std::min(tail, m - head);
+  m_ = head + tail;
+  data_ = std::vector<real>(m_ * n_);
+  in.read((char*)data_.data(), head * n_ * sizeof(real));
+  in.seekg((m - m_) * n_ * sizeof(real), std::ios_base::cur);
+  in.read((char*)(data_.data() + head * n_), tail * n_ * sizeof(real));
+}
+
 void Matrix::dump(std::ostream& out) const {
   out << m_ << " " << n_ << std::endl;
+  int32_t precision = out.precision();
+  std::string line;
+  char buffer[32];
   for (int64_t i = 0; i < m_; i++) {
+    line.clear();
     for (int64_t j = 0; j < n_; j++) {
       if (j > 0) {
-        out << " ";
+        line += ' ';
       }
-      out << at(i, j);
+      line.append(buffer, utils::formatReal(at(i, j), precision, buffer));
     }
-    out << std::endl;
+    line += '\n';
+    out << line;
   }
+  out.flush();
 };
 
 }
@@ -24,7 +24,7 @@ class Vector;
 class Matrix {
  protected:
   std::vector<real> data_;
-  const int64_t m_;
+  int64_t m_;
   const int64_t n_;
 
  public:
@@ -66,13 +66,22 @@ class Matrix {
   void addRow(const Vector&, int64_t, real);
 
   void multiplyRow(const Vector& nums, int64_t ib = 0, int64_t ie = -1);
-  void divideRow(const Vector& denoms, int64_t ib = 0, int64_t ie = -1);
+  void divideRow(
+      const Vector& denoms,
+      int64_t ib = 0,
+      int64_t ie = -1,
+      int32_t nthreads = 1);
 
   real l2NormRow(int64_t i) const;
-  void l2NormRow(Vector& norms) const;
+  void l2NormRow(Vector& norms, int32_t nthreads = 1) const;
+
+  // Keeps only the rows listed in idx, which must be strictly increasing,
+  // moving them in place and releasing the memory of the others.
+  void keepRows(const std::vector<int32_t>& idx, int32_t nthreads = 1);
 
   void save(std::ostream&);
   void load(std::istream&);
+  void load(std::istream&, int64_t, int64_t);
 
   void dump(std::ostream&) const;
 };
@@ -14,6 +14,8 @@
 #include <algorithm>
 #include <stdexcept>
 
+#include "instrument.h"
+
 namespace fasttext {
 
 constexpr int64_t SIGMOID_TABLE_SIZE = 512;
@@ -66,6 +68,7 @@ real Model::binaryLogistic(int32_t target, bool label, real lr) {
 }
 
 real Model::negativeSampling(int32_t target, real lr) {
+  FASTTEXT_PROBE(loss);
   real loss = 0.0;
   grad_.zero();
   for (int32_t n = 0; n <= args_->neg; n++) {
@@ -79,6 +82,7 @@ real Model::negativeSampling(int32_t target, real lr) {
 }
 
 real Model::hierarchicalSoftmax(int32_t target, real lr) {
+  FASTTEXT_PROBE(loss);
   real loss = 0.0;
   grad_.zero();
   const std::vector<bool>& binaryCode = codes[target];
@@ -90,8 +94,15 @@ real Model::hierarchicalSoftmax(int32_t target, real lr) {
 }
 
 void Model::computeOutputSoftmax(Vector& hidden, Vector& output) const {
+  std::vector<real> table;
+  computeOutputSoftmax(hidden, output, table);
+}
+
+// table is the scratch space of the quantized output matrix.
+void Model::computeOutputSoftmax(Vector& hidden, Vector& output,
+                                 std::vector<real>& table) const {
   if (quant_ && args_->qout) {
-    output.mul(*qwo_, hidden);
+    qwo_->dotRows(hidden, output, table);
   } else {
     output.mul(*wo_, hidden);
   }
@@ -113,6 +124,7 @@ void Model::computeOutputSoftmax() {
 }
 
 real Model::softmax(int32_t target, real lr) {
+  FASTTEXT_PROBE(loss);
   grad_.zero();
   computeOutputSoftmax();
   for (int32_t i = 0; i < osz_; i++) {
@@ -125,12 +137,13 @@ real Model::softmax(int32_t target, real lr) {
 }
 
 void Model::computeHidden(const std::vector<int32_t>& input, Vector& hidden) const {
+  FASTTEXT_PROBE(computeHidden);
   assert(hidden.size() == hsz_);
   hidden.zero();
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    if(quant_) {
-      hidden.addRow(*qwi_, *it);
-    } else {
+  if (quant_) {
+    qwi_->addRowsToVector(hidden, input);
+  } else {
+    for (auto it = input.cbegin(); it != input.cend(); ++it) {
       hidden.addRow(*wi_, *it);
     }
   }
@@ -145,6 +158,15 @@ bool Model::comparePairs(const std::pair<real, int32_t> &l,
 void Model::predict(const std::vector<int32_t>& input, int32_t k, real threshold,
                     std::vector<std::pair<real, int32_t>>& heap,
                     Vector& hidden, Vector& output) const {
+  std::vector<real> table;
+  predict(input, k, threshold, heap, hidden, output, table);
+}
+
+void Model::predict(const std::vector<int32_t>& input, int32_t k, real threshold,
+                    std::vector<std::pair<real, int32_t>>& heap,
+                    Vector& hidden, Vector& output,
+                    std::vector<real>& table) const {
+  FASTTEXT_PROBE(predict);
   if (k <= 0) {
     throw std::invalid_argument("k needs to be 1 or higher!");
   }
@@ -156,7 +178,7 @@ void Model::predict(const std::vector<int32_t>& input, int32_t k, real threshold
   if (args_->loss == loss_name::hs) {
     dfs(k, threshold, 2 * osz_ - 2, 0.0, heap, hidden);
   } else {
-    findKBest(k, threshold, heap, hidden, output);
+    findKBest(k, threshold, heap, hidden, output, table);
   }
   std::sort_heap(heap.begin(), heap.end(), comparePairs);
 }
@@ -166,17 +188,19 @@ void Model::predict(
   int32_t k,
   real threshold,
   std::vector<std::pair<real, int32_t>>& heap
-) {
-  predict(input, k, threshold, heap, hidden_, output_);
+) const {
+  Vector hidden(hsz_), output(osz_);
+  predict(input, k, threshold, heap, hidden, output);
 }
 
 void Model::findKBest(
   int32_t k,
   real threshold,
   std::vector<std::pair<real, int32_t>>& heap,
-  Vector& hidden, Vector& output
+  Vector& hidden, Vector& output,
+  std::vector<real>& table
 ) const {
-  computeOutputSoftmax(hidden, output);
+  computeOutputSoftmax(hidden, output, table);
   for (int32_t i = 0; i < osz_; i++) {
     if (output[i] < threshold) continue;
     if (heap.size() == k && std_log(output[i]) < heap.front().first) {
@@ -235,6 +259,7 @@ void Model::update(const std::vector<int32_t>& input, int32_t target, real lr) {
   }
   nexamples_ += 1;
 
+  FASTTEXT_PROBE(updateScatter);
   if (args_->model == model_name::sup) {
     grad_.mul(1.0 / input.size());
   }
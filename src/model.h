@@ -76,15 +76,19 @@ class Model {
                  std::vector<std::pair<real, int32_t>>&,
                  Vector&, Vector&) const;
     void predict(const std::vector<int32_t>&, int32_t, real,
-                 std::vector<std::pair<real, int32_t>>&);
+                 std::vector<std::pair<real, int32_t>>&,
+                 Vector&, Vector&, std::vector<real>&) const;
+    void predict(const std::vector<int32_t>&, int32_t, real,
+                 std::vector<std::pair<real, int32_t>>&) const;
     void dfs(int32_t, real, int32_t, real,
              std::vector<std::pair<real, int32_t>>&,
              Vector&) const;
     void findKBest(int32_t, real, std::vector<std::pair<real, int32_t>>&,
-                   Vector&, Vector&) const;
+                   Vector&, Vector&, std::vector<real>&) const;
     void update(const std::vector<int32_t>&, int32_t, real);
     void computeHidden(const std::vector<int32_t>&, Vector&) const;
     void computeOutputSoftmax(Vector&, Vector&) const;
+    void computeOutputSoftmax(Vector&, Vector&, std::vector<real>&) const;
     void computeOutputSoftmax();
 
     void setTargetCounts(const std::vector<int64_t>&);
@@ -14,8 +14,17 @@
 #include <numeric>
 #include <stdexcept>
 
+#include "utils.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 namespace fasttext {
 
+const int32_t ESTEP_BLOCK_SIZE = 64;
+const int32_t ARGMIN_LANES = 8;
+
 real distL2(const real* x, const real* y, int32_t d) {
   real dist = 0;
   for (auto i = 0; i < d; i++) {
@@ -25,8 +34,75 @@ real distL2(const real* x, const real* y, int32_t d) {
   return dist;
 }
 
-ProductQuantizer::ProductQuantizer(int32_t dim, int32_t dsub): dim_(dim),
-  nsubq_(dim / dsub), dsub_(dsub), centroids_(dim * ksub_), rng(seed_) {
+void transposeCentroids(const real* c, real* ct, real* cnorms,
+                        int32_t d, int32_t k) {
+  for (auto j = 0; j < k; j++) {
+    real norm = 0;
+    for (auto i = 0; i < d; i++) {
+      ct[i * k + j] = c[j * d + i];
+      norm += c[j * d + i] * c[j * d + i];
+    }
+    cnorms[j] = norm;
+  }
+}
+
+// Since ||x - c||^2 = ||x||^2 - 2 <x, c> + ||c||^2 and ||x||^2 does not
+// depend on c, the nearest centroid of every point of a block is the argmin
+// of one row of ||c||^2 - 2 X C^T, which is computed as a small matrix
+// product against the transposed centroids ct (d x k).
+void assignBlock(const real* x, const real* ct, const real* cnorms,
+                 uint8_t* codes, real* dists, int32_t d, int32_t k,
+                 int32_t n) {
+  for (auto i = 0; i < n; i++) {
+    real* dist = dists + i * k;
+    memcpy(dist, cnorms, k * sizeof(real));
+  }
+  for (auto l = 0; l < d; l++) {
+    const real* c = ct + l * k;
+    for (auto i = 0; i < n; i++) {
+      real* dist = dists + i * k;
+      real xl = -2 * x[i * d + l];
+      for (auto j = 0; j < k; j++) {
+        dist[j] += xl * c[j];
+      }
+    }
+  }
+  for (auto i = 0; i < n; i++) {
+    const real* dist = dists + i * k;
+    real best = dist[0];
+    auto j = 0;
+    if (k >= ARGMIN_LANES) {
+      real lanes[ARGMIN_LANES];
+      memcpy(lanes, dist, sizeof(lanes));
+      for (j = ARGMIN_LANES; j + ARGMIN_LANES <= k; j += ARGMIN_LANES) {
+        for (auto l = 0; l < ARGMIN_LANES; l++) {
+          lanes[l] = dist[j + l] < lanes[l] ? dist[j + l] : lanes[l];
+        }
+      }
+      for (auto l = 0; l < ARGMIN_LANES; l++) {
+        best = lanes[l] < best ? lanes[l] : best;
+      }
+    }
+    for (; j < k; j++) {
+      best = dist[j] < best ? dist[j] : best;
+    }
+    int32_t code = 0;
+    while (code < k - 1 && dist[code] != best) {
+      code++;
+    }
+    codes[i] = (uint8_t) code;
+  }
+}
+
+ProductQuantizer::ProductQuantizer(int32_t dim, int32_t dsub, int32_t nbits)
+    : nbits_(nbits), ksub_(1 << nbits),
+      max_points_(max_points_per_cluster_ * ksub_), dim_(dim),
+      nsubq_(dim / dsub), dsub_(dsub), centroids_(dim * ksub_) {
+  if (nbits != 4 && nbits != 8) {
+    throw std::invalid_argument(
+        "Unsupported number of bits per code: " + std::to_string(nbits) +
+        " (must be 4 or 8)");
+  }
   lastdsub_ = dim_ % dsub;
   if (lastdsub_ == 0) {lastdsub_ = dsub_;}
   else {nsubq_++;}
@@ -61,14 +137,21 @@ real ProductQuantizer::assign_centroid(const real * x, const real* c0,
 void ProductQuantizer::Estep(const real* x, const real* centroids,
                              uint8_t* codes, int32_t d,
                              int32_t n) const {
-  for (auto i = 0; i < n; i++) {
-    assign_centroid(x + i * d, centroids, codes + i, d);
+  std::vector<real> ct(d * ksub_);
+  std::vector<real> cnorms(ksub_);
+  std::vector<real> dists(ESTEP_BLOCK_SIZE * ksub_);
+  transposeCentroids(centroids, ct.data(), cnorms.data(), d, ksub_);
+  for (auto i = 0; i < n; i += ESTEP_BLOCK_SIZE) {
+    auto nb = std::min(ESTEP_BLOCK_SIZE, n - i);
+    assignBlock(x + i * d, ct.data(), cnorms.data(), codes + i,
+                dists.data(), d, ksub_, nb);
   }
 }
 
 void ProductQuantizer::MStep(const real* x0, real* centroids,
                              const uint8_t* codes,
-                             int32_t d, int32_t n) {
+                             int32_t d, int32_t n,
+                             std::minstd_rand& rng) const {
   std::vector<int32_t> nelts(ksub_, 0);
   memset(centroids, 0, sizeof(real) * d * ksub_);
   const real* x = x0;
@@ -112,7 +195,8 @@ void ProductQuantizer::MStep(const real* x0, real* centroids,
   }
 }
 
-void ProductQuantizer::kmeans(const real *x, real* c, int32_t n, int32_t d) {
+void ProductQuantizer::kmeans(const real *x, real* c, int32_t n, int32_t d,
+                              std::minstd_rand& rng) const {
   std::vector<int32_t> perm(n,0);
   std::iota(perm.begin(), perm.end(), 0);
   std::shuffle(perm.begin(), perm.end(), rng);
@@ -122,40 +206,44 @@ void ProductQuantizer::kmeans(const real *x, real* c, int32_t n, int32_t d) {
   auto codes = std::vector<uint8_t>(n);
   for (auto i = 0; i < niter_; i++) {
     Estep(x, c, codes.data(), d, n);
-    MStep(x, c, codes.data(), d, n);
+    MStep(x, c, codes.data(), d, n, rng);
   }
 }
 
-void ProductQuantizer::train(int32_t n, const real * x) {
+void ProductQuantizer::train(int32_t n, const real * x, int32_t nthreads) {
   if (n < ksub_) {
     throw std::invalid_argument(
         "Matrix too small for quantization, must have at least " + std::to_string(ksub_) + " rows");
   }
-  std::vector<int32_t> perm(n, 0);
-  std::iota(perm.begin(), perm.end(), 0);
-  auto d = dsub_;
   auto np = std::min(n, max_points_);
-  auto xslice = std::vector<real>(np * dsub_);
-  for (auto m = 0; m < nsubq_; m++) {
-    if (m == nsubq_-1) {d = lastdsub_;}
-    if (np != n) {std::shuffle(perm.begin(), perm.end(), rng);}
-    for (auto j = 0; j < np; j++) {
-      memcpy(
-          xslice.data() + j * d,
-          x + perm[j] * dim_ + m * dsub_,
-          d * sizeof(real));
+  // Every sub-quantizer draws from its own generator, so the codebooks only
+  // depend on the seed and not on how sub-quantizers are spread on threads.
+  utils::parallelFor(0, nsubq_, nthreads, [&](int64_t mb, int64_t me) {
+    std::vector<int32_t> perm(n, 0);
+    auto xslice = std::vector<real>(np * dsub_);
+    for (auto m = mb; m < me; m++) {
+      std::minstd_rand rng(seed_ + m);
+      auto d = (m == nsubq_ - 1) ? lastdsub_ : dsub_;
+      std::iota(perm.begin(), perm.end(), 0);
+      if (np != n) {std::shuffle(perm.begin(), perm.end(), rng);}
+      for (auto j = 0; j < np; j++) {
+        memcpy(
+            xslice.data() + j * d,
+            x + int64_t(perm[j]) * dim_ + m * dsub_,
+            d * sizeof(real));
+      }
+      kmeans(xslice.data(), get_centroids(m, 0), np, d, rng);
     }
-    kmeans(xslice.data(), get_centroids(m, 0), np, d);
-  }
+  });
 }
 
 real ProductQuantizer::mulcode(const Vector& x, const uint8_t* codes,
                                int32_t t, real alpha) const {
   real res = 0.0;
   auto d = dsub_;
-  const uint8_t* code = codes + nsubq_ * t;
+  const uint8_t* code = codes + int64_t(code_size()) * t;
   for (auto m = 0; m < nsubq_; m++) {
-    const real* c = get_centroids(m, code[m]);
+    const real* c = get_centroids(m, get_code(code, m));
     if (m == nsubq_ - 1) {d = lastdsub_;}
     for(auto n = 0; n < d; n++) {
       res += x[m * dsub_ + n] * c[n];
@@ -164,12 +252,88 @@ real ProductQuantizer::mulcode(const Vector& x, const uint8_t* codes,
   return res * alpha;
 }
 
+void ProductQuantizer::compute_dot_table(const Vector& x,
+                                         std::vector<real>& table) const {
+  table.resize(nsubq_ * ksub_);
+  auto d = dsub_;
+  for (auto m = 0; m < nsubq_; m++) {
+    if (m == nsubq_ - 1) {d = lastdsub_;}
+    const real* xsub = x.data() + m * dsub_;
+    real* t = table.data() + m * ksub_;
+    for (auto j = 0; j < ksub_; j++) {
+      const real* c = get_centroids(m, j);
+      real dot = 0.0;
+      for (auto n = 0; n < d; n++) {
+        dot += xsub[n] * c[n];
+      }
+      t[j] = dot;
+    }
+  }
+}
+
+real ProductQuantizer::mulcode_table(const real* table, const uint8_t* codes,
+                                     int32_t t, real alpha) const {
+  real res = 0.0;
+  const uint8_t* code = codes + int64_t(code_size()) * t;
+  for (auto m = 0; m < nsubq_; m++) {
+    res += table[m * ksub_ + get_code(code, m)];
+  }
+  return res * alpha;
+}
+
+#if defined(__AVX2__)
+// Looks up 8 entries of a 16-entry table at once: each half of the table
+// fits in one register, and the fourth bit of the index picks the half.
+inline __m256 lookup16(const real* table, __m256i idx) {
+  __m256 lo = _mm256_permutevar8x32_ps(_mm256_loadu_ps(table), idx);
+  __m256 hi = _mm256_permutevar8x32_ps(_mm256_loadu_ps(table + 8), idx);
+  __m256 upper = _mm256_castsi256_ps(_mm256_slli_epi32(idx, 28));
+  return _mm256_blendv_ps(lo, hi, upper);
+}
+#endif
+
+void ProductQuantizer::mulcodes_table(const real* table, const uint8_t* codes,
+                                      int64_t n, real* out) const {
+  int64_t i = 0;
+#if defined(__AVX2__)
+  if (nbits_ == 4) {
+    // Fast scan: 8 rows are scored together, with the table lookups done by
+    // register permutes. Sums are accumulated in the same order as
+    // mulcode_table, so both paths give identical results.
+    const int64_t cs = code_size();
+    const __m256i rows = _mm256_mullo_epi32(
+        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(cs));
+    const __m256i mask = _mm256_set1_epi32(0xF);
+    // Each gather reads four bytes per row, so the last rows are left to
+    // the scalar loop rather than reading past the end of the codes.
+    for (; (i + 8) * cs + 3 <= n * cs; i += 8) {
+      const uint8_t* block = codes + i * cs;
+      __m256 acc = _mm256_setzero_ps();
+      for (auto m = 0; m < nsubq_; m += 2) {
+        __m256i c = _mm256_i32gather_epi32(
+            (const int*) (block + (m >> 1)), rows, 1);
+        acc = _mm256_add_ps(
+            acc, lookup16(table + m * ksub_, _mm256_and_si256(c, mask)));
+        if (m + 1 < nsubq_) {
+          __m256i c1 = _mm256_and_si256(_mm256_srli_epi32(c, 4), mask);
+          acc = _mm256_add_ps(acc, lookup16(table + (m + 1) * ksub_, c1));
+        }
+      }
+      _mm256_storeu_ps(out + i, acc);
+    }
+  }
+#endif
+  for (; i < n; i++) {
+    out[i] = mulcode_table(table, codes, i, 1.0);
+  }
+}
+
 void ProductQuantizer::addcode(Vector& x, const uint8_t* codes,
                                int32_t t, real alpha) const {
   auto d = dsub_;
-  const uint8_t* code = codes + nsubq_ * t;
+  const uint8_t* code = codes + int64_t(code_size()) * t;
   for (auto m = 0; m < nsubq_; m++) {
-    const real* c = get_centroids(m, code[m]);
+    const real* c = get_centroids(m, get_code(code, m));
     if (m == nsubq_ - 1) {d = lastdsub_;}
     for(auto n = 0; n < d; n++) {
       x[m * dsub_ + n] += alpha * c[n];
@@ -177,19 +341,57 @@ void ProductQuantizer::addcode(Vector& x, const uint8_t* codes,
   }
 }
 
+void ProductQuantizer::set_code(uint8_t* code, int32_t m, uint8_t c) const {
+  if (nbits_ == 4) {
+    auto shift = (m & 1) << 2;
+    code[m >> 1] = (code[m >> 1] & ~(0xF << shift)) | (c << shift);
+  } else {
+    code[m] = c;
+  }
+}
+
 void ProductQuantizer::compute_code(const real* x, uint8_t* code) const {
   auto d = dsub_;
   for (auto m = 0; m < nsubq_; m++) {
     if (m == nsubq_ - 1) {d = lastdsub_;}
-    assign_centroid(x + m * dsub_, get_centroids(m, 0), code + m, d);
+    uint8_t c;
+    assign_centroid(x + m * dsub_, get_centroids(m, 0), &c, d);
+    set_code(code, m, c);
   }
 }
 
 void ProductQuantizer::compute_codes(const real* x, uint8_t* codes,
-                                     int32_t n) const {
-  for (auto i = 0; i < n; i++) {
-    compute_code(x + i * dim_, codes + i * nsubq_);
+                                     int32_t n, int32_t nthreads) const {
+  std::vector<real> ct(dim_ * ksub_);
+  std::vector<real> cnorms(nsubq_ * ksub_);
+  auto d = dsub_;
+  for (auto m = 0; m < nsubq_; m++) {
+    if (m == nsubq_ - 1) {d = lastdsub_;}
+    transposeCentroids(get_centroids(m, 0), ct.data() + m * ksub_ * dsub_,
+                       cnorms.data() + m * ksub_, d, ksub_);
   }
+  utils::parallelFor(0, n, nthreads, [&](int64_t ib, int64_t ie) {
+    std::vector<real> xslice(ESTEP_BLOCK_SIZE * dsub_);
+    std::vector<real> dists(ESTEP_BLOCK_SIZE * ksub_);
+    std::vector<uint8_t> block(ESTEP_BLOCK_SIZE);
+    for (auto i = ib; i < ie; i += ESTEP_BLOCK_SIZE) {
+      int32_t nb = std::min<int64_t>(ESTEP_BLOCK_SIZE, ie - i);
+      auto d = dsub_;
+      for (auto m = 0; m < nsubq_; m++) {
+        if (m == nsubq_ - 1) {d = lastdsub_;}
+        for (auto j = 0; j < nb; j++) {
+          memcpy(xslice.data() + j * d, x + (i + j) * dim_ + m * dsub_,
+                 d * sizeof(real));
+        }
+        assignBlock(xslice.data(), ct.data() + m * ksub_ * dsub_,
+                    cnorms.data() + m * ksub_, block.data(), dists.data(),
+                    d, ksub_, nb);
+        for (auto j = 0; j < nb; j++) {
+          set_code(codes + (i + j) * code_size(), m, block[j]);
+        }
+      }
+    }
+  });
 }
 
 void ProductQuantizer::save(std::ostream& out) {
@@ -200,7 +402,10 @@ void ProductQuantizer::save(std::ostream& out) {
   out.write((char*) centroids_.data(), centroids_.size() * sizeof(real));
 }
 
-void ProductQuantizer::load(std::istream& in) {
+void ProductQuantizer::load(std::istream& in, int32_t nbits) {
+  nbits_ = nbits;
+  ksub_ = 1 << nbits_;
+  max_points_ = max_points_per_cluster_ * ksub_;
   in.read((char*) &dim_, sizeof(dim_));
   in.read((char*) &nsubq_, sizeof(nsubq_));
   in.read((char*) &dsub_, sizeof(dsub_));
@@ -22,12 +22,12 @@ namespace fasttext {
 
 class ProductQuantizer {
   protected:
-    const int32_t nbits_ = 8;
-    const int32_t ksub_ = 1 << nbits_;
+    int32_t nbits_ = 8;
+    int32_t ksub_ = 1 << nbits_;
     const int32_t max_points_per_cluster_ = 256;
-    const int32_t max_points_ = max_points_per_cluster_ * ksub_;
+    int32_t max_points_ = max_points_per_cluster_ * ksub_;
     const int32_t seed_ = 1234;
-    const int32_t niter_ = 25;
+    int32_t niter_ = 25;
     const real eps_ = 1e-7;
 
     int32_t dim_;
@@ -37,28 +37,49 @@ class ProductQuantizer {
 
     std::vector<real> centroids_;
 
-    std::minstd_rand rng;
+    void set_code(uint8_t*, int32_t, uint8_t) const;
 
   public:
     ProductQuantizer() {}
-    ProductQuantizer(int32_t, int32_t);
+    ProductQuantizer(int32_t, int32_t, int32_t = 8);
 
     real* get_centroids (int32_t, uint8_t);
     const real* get_centroids(int32_t, uint8_t) const;
 
+    int32_t get_ksub() const { return ksub_; }
+    int32_t get_nbits() const { return nbits_; }
+    int32_t get_max_points() const { return max_points_; }
+    void set_niter(int32_t niter) { niter_ = niter; }
+    // Number of bytes used to encode one vector: 8-bit codes take one byte
+    // per sub-quantizer, 4-bit codes pack two sub-quantizers per byte.
+    int32_t code_size() const {
+      return nbits_ == 4 ? (nsubq_ + 1) / 2 : nsubq_;
+    }
+    inline uint8_t get_code(const uint8_t* code, int32_t m) const {
+      if (nbits_ == 4) {
+        return (code[m >> 1] >> ((m & 1) << 2)) & 0xF;
+      }
+      return code[m];
+    }
+
     real assign_centroid(const real*, const real*, uint8_t*, int32_t) const;
     void Estep(const real*, const real*, uint8_t*, int32_t, int32_t) const;
-    void MStep(const real*, real*, const uint8_t*, int32_t, int32_t);
-    void kmeans(const real*, real*, int32_t, int32_t);
-    void train(int, const real*);
+    void MStep(const real*, real*, const uint8_t*, int32_t, int32_t,
+               std::minstd_rand&) const;
+    void kmeans(const real*, real*, int32_t, int32_t,
+                std::minstd_rand&) const;
+    void train(int, const real*, int32_t = 1);
 
     real mulcode(const Vector&, const uint8_t*, int32_t, real) const;
+    void compute_dot_table(const Vector&, std::vector<real>&) const;
+    real mulcode_table(const real*, const uint8_t*, int32_t, real) const;
+    void mulcodes_table(const real*, const uint8_t*, int64_t, real*) const;
     void addcode(Vector&, const uint8_t*, int32_t, real) const;
     void compute_code(const real*, uint8_t*)  const;
-    void compute_codes(const real*, uint8_t*, int32_t)  const;
+    void compute_codes(const real*, uint8_t*, int32_t, int32_t = 1)  const;
 
     void save(std::ostream&);
-    void load(std::istream&);
+    void load(std::istream&, int32_t = 8);
 };
 
 }
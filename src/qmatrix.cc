@@ -10,46 +10,317 @@
 #include "qmatrix.h"
 
 #include <assert.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <numeric>
+#include <random>
+
+#include "utils.h"
 
 namespace fasttext {
 
-QMatrix::QMatrix() : qnorm_(false),
+namespace {
+
+constexpr int32_t OPQ_NITER = 8;
+constexpr int32_t OPQ_KMEANS_NITER = 4;
+constexpr int64_t OPQ_BLOCK_SIZE = 256;
+constexpr int64_t QUANTIZE_BLOCK_SIZE = 8192;
+constexpr int64_t MAX_SAMPLE_POINTS = 65536;
+constexpr int32_t SAMPLE_SEED = 1234;
+
+// Replaces every row x_i of the m x n matrix x by x_i R.
+void rotateRows(real* x, const Matrix& r, int64_t m, int32_t nthreads) {
+  int64_t n = r.size(0);
+  utils::parallelFor(0, m, nthreads, [&](int64_t ib, int64_t ie) {
+    std::vector<real> y(n);
+    for (int64_t i = ib; i < ie; i++) {
+      real* xi = x + i * n;
+      std::fill(y.begin(), y.end(), 0.0);
+      for (int64_t k = 0; k < n; k++) {
+        const real* rk = r.data() + k * n;
+        real xik = xi[k];
+        for (int64_t j = 0; j < n; j++) {
+          y[j] += xik * rk[j];
+        }
+      }
+      std::copy(y.begin(), y.end(), xi);
+    }
+  });
+}
+
+// Cyclic Jacobi eigen-decomposition of the symmetric n x n matrix a. On
+// return the diagonal of a holds the eigenvalues and the columns of v the
+// matching eigenvectors.
+void jacobiEigen(std::vector<double>& a, std::vector<double>& v, int64_t n) {
+  v.assign(n * n, 0.0);
+  for (int64_t i = 0; i < n; i++) {
+    v[i * n + i] = 1.0;
+  }
+  for (int32_t sweep = 0; sweep < 100; sweep++) {
+    double off = 0.0, diag = 0.0;
+    for (int64_t p = 0; p < n; p++) {
+      diag += a[p * n + p] * a[p * n + p];
+      for (int64_t q = p + 1; q < n; q++) {
+        off += a[p * n + q] * a[p * n + q];
+      }
+    }
+    if (off <= 1e-24 * diag) {
+      break;
+    }
+    for (int64_t p = 0; p < n; p++) {
+      for (int64_t q = p + 1; q < n; q++) {
+        double apq = a[p * n + q];
+        if (apq == 0.0) {
+          continue;
+        }
+        double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+        double t = 1.0 / (std::abs(theta) + std::sqrt(theta * theta + 1.0));
+        if (theta < 0) {
+          t = -t;
+        }
+        double c = 1.0 / std::sqrt(t * t + 1.0);
+        double s = t * c;
+        for (int64_t k = 0; k < n; k++) {
+          double akp = a[k * n + p], akq = a[k * n + q];
+          a[k * n + p] = c * akp - s * akq;
+          a[k * n + q] = s * akp + c * akq;
+        }
+        for (int64_t k = 0; k < n; k++) {
+          double apk = a[p * n + k], aqk = a[q * n + k];
+          a[p * n + k] = c * apk - s * aqk;
+          a[q * n + k] = s * apk + c * aqk;
+        }
+        for (int64_t k = 0; k < n; k++) {
+          double vkp = v[k * n + p], vkq = v[k * n + q];
+          v[k * n + p] = c * vkp - s * vkq;
+          v[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+}
+
+// Orthogonal matrix closest to the n x n matrix m, i.e. the polar factor
+// U V^T of m = U S V^T. It is computed as m V S^-1 V^T, with V and S^2
+// given by the eigen-decomposition of m^T m.
+void orthogonalPolar(const std::vector<double>& m, Matrix& r, int64_t n) {
+  std::vector<double> mtm(n * n, 0.0);
+  for (int64_t i = 0; i < n; i++) {
+    for (int64_t k = 0; k < n; k++) {
+      double mik = m[i * n + k];
+      for (int64_t j = 0; j < n; j++) {
+        mtm[k * n + j] += mik * m[i * n + j];
+      }
+    }
+  }
+  std::vector<double> v;
+  jacobiEigen(mtm, v, n);
+  double smax = 0.0;
+  for (int64_t i = 0; i < n; i++) {
+    smax = std::max(smax, mtm[i * n + i]);
+  }
+  // w = V S^-1, directions with a vanishing singular value are dropped.
+  std::vector<double> w(n * n, 0.0);
+  for (int64_t j = 0; j < n; j++) {
+    double s = mtm[j * n + j];
+    if (s <= 1e-12 * smax) {
+      continue;
+    }
+    double inv = 1.0 / std::sqrt(s);
+    for (int64_t k = 0; k < n; k++) {
+      w[k * n + j] = v[k * n + j] * inv;
+    }
+  }
+  // r = (m w) V^T
+  std::vector<double> mw(n * n, 0.0);
+  for (int64_t i = 0; i < n; i++) {
+    for (int64_t k = 0; k < n; k++) {
+      double mik = m[i * n + k];
+      for (int64_t j = 0; j < n; j++) {
+        mw[i * n + j] += mik * w[k * n + j];
+      }
+    }
+  }
+  for (int64_t i = 0; i < n; i++) {
+    for (int64_t j = 0; j < n; j++) {
+      double sum = 0.0;
+      for (int64_t k = 0; k < n; k++) {
+        sum += mw[i * n + k] * v[j * n + k];
+      }
+      r.at(i, j) = sum;
+    }
+  }
+}
+
+}
+
+QMatrix::QMatrix() : qnorm_(false), rotate_(false),
   m_(0), n_(0), codesize_(0) {}
 
-QMatrix::QMatrix(const Matrix& mat, int32_t dsub, bool qnorm)
-      : qnorm_(qnorm), m_(mat.size(0)), n_(mat.size(1)),
-        codesize_(m_ * ((n_ + dsub - 1) / dsub)) {
+QMatrix::QMatrix(const Matrix& mat, int32_t dsub, bool qnorm,
+                 int32_t nbits, bool rotate, int32_t nthreads)
+      : qnorm_(qnorm), rotate_(rotate),
+        m_(mat.size(0)), n_(mat.size(1)), codesize_(0) {
+  pq_ = std::unique_ptr<ProductQuantizer>(
+      new ProductQuantizer(n_, dsub, nbits));
+  codesize_ = m_ * pq_->code_size();
   codes_.resize(codesize_);
-  pq_ = std::unique_ptr<ProductQuantizer>( new ProductQuantizer(n_, dsub));
   if (qnorm_) {
     norm_codes_.resize(m_);
     npq_ = std::unique_ptr<ProductQuantizer>( new ProductQuantizer(1, 1));
   }
-  quantize(mat);
+  quantize(mat, nthreads);
 }
 
-void QMatrix::quantizeNorm(const Vector& norms) {
+void QMatrix::quantizeNorm(const Vector& norms, int32_t nthreads) {
   assert(qnorm_);
   assert(norms.size() == m_);
   auto dataptr = norms.data();
   npq_->train(m_, dataptr);
-  npq_->compute_codes(dataptr, norm_codes_.data(), m_);
+  npq_->compute_codes(dataptr, norm_codes_.data(), m_, nthreads);
+}
+
+// Copies the given rows of matrix to out, divided by their norm when the
+// norm is quantized separately.
+void QMatrix::gatherRows(const Matrix& matrix, const Vector& norms,
+                         const int64_t* rows, int64_t n, real* out,
+                         int32_t nthreads) const {
+  utils::parallelFor(0, n, nthreads, [&](int64_t ib, int64_t ie) {
+    for (int64_t i = ib; i < ie; i++) {
+      const real* src = matrix.data() + rows[i] * n_;
+      real* dst = out + i * n_;
+      real norm = qnorm_ ? norms[rows[i]] : 0.0;
+      for (int64_t j = 0; j < n_; j++) {
+        dst[j] = norm != 0 ? src[j] / norm : src[j];
+      }
+    }
+  });
 }
 
-void QMatrix::quantize(const Matrix& matrix) {
+// The codebooks are trained on a bounded sample of the rows, and the rows
+// are then normalized, rotated and encoded block by block, so that the
+// matrix is never copied as a whole.
+void QMatrix::quantize(const Matrix& matrix, int32_t nthreads) {
   assert(m_ == matrix.size(0));
   assert(n_ == matrix.size(1));
-  Matrix temp(matrix);
+  Vector norms(qnorm_ ? m_ : 0);
   if (qnorm_) {
-    Vector norms(temp.size(0));
-    temp.l2NormRow(norms);
-    temp.divideRow(norms);
-    quantizeNorm(norms);
+    matrix.l2NormRow(norms, nthreads);
+    quantizeNorm(norms, nthreads);
+  }
+  int64_t np = std::min(
+      m_, std::max<int64_t>(pq_->get_max_points(), MAX_SAMPLE_POINTS));
+  std::vector<int64_t> rows(m_);
+  std::iota(rows.begin(), rows.end(), 0);
+  if (np != m_) {
+    std::minstd_rand rng(SAMPLE_SEED);
+    std::shuffle(rows.begin(), rows.end(), rng);
+    rows.resize(np);
+    std::sort(rows.begin(), rows.end());
+  }
+  {
+    Matrix sample(np, n_);
+    gatherRows(matrix, norms, rows.data(), np, sample.data(), nthreads);
+    rows = std::vector<int64_t>();
+    if (rotate_) {
+      trainRotation(sample, nthreads);
+      rotateRows(sample.data(), *rotation_, np, nthreads);
+    }
+    pq_->train(np, sample.data(), nthreads);
+    if (np == m_) {
+      pq_->compute_codes(sample.data(), codes_.data(), m_, nthreads);
+      return;
+    }
+  }
+
+  int64_t bsize = std::min(m_, QUANTIZE_BLOCK_SIZE);
+  std::vector<real> block(bsize * n_);
+  std::vector<int64_t> brows(bsize);
+  for (int64_t b = 0; b < m_; b += bsize) {
+    int64_t n = std::min(m_ - b, bsize);
+    std::iota(brows.begin(), brows.end(), b);
+    gatherRows(matrix, norms, brows.data(), n, block.data(), nthreads);
+    if (rotate_) {
+      rotateRows(block.data(), *rotation_, n, nthreads);
+    }
+    pq_->compute_codes(
+        block.data(), codes_.data() + b * pq_->code_size(), n, nthreads);
+  }
+}
+
+// Learns the rotation by alternating between training product quantizers on
+// the rotated sample and solving the orthogonal Procrustes problem
+// min_R ||X R - Y||, where Y holds the reconstructions of X R.
+void QMatrix::trainRotation(const Matrix& xs, int32_t nthreads) {
+  int64_t np = xs.size(0);
+  rotation_ = std::unique_ptr<Matrix>(new Matrix(n_, n_));
+  rotation_->zero();
+  for (int64_t i = 0; i < n_; i++) {
+    rotation_->at(i, i) = 1.0;
+  }
+  Matrix ys(np, n_);
+  std::vector<uint8_t> codes(np * pq_->code_size());
+  std::vector<double> m(n_ * n_);
+  for (int32_t it = 0; it < OPQ_NITER; it++) {
+    memcpy(ys.data(), xs.data(), np * n_ * sizeof(real));
+    rotateRows(ys.data(), *rotation_, np, nthreads);
+    ProductQuantizer pq(*pq_);
+    pq.set_niter(OPQ_KMEANS_NITER);
+    pq.train(np, ys.data(), nthreads);
+    pq.compute_codes(ys.data(), codes.data(), np, nthreads);
+    utils::parallelFor(0, np, nthreads, [&](int64_t ib, int64_t ie) {
+      Vector y(n_);
+      for (int64_t i = ib; i < ie; i++) {
+        y.zero();
+        pq.addcode(y, codes.data(), i, 1.0);
+        memcpy(ys.data() + i * n_, y.data(), n_ * sizeof(real));
+      }
+    });
+    // m = X^T Y, every thread owns a range of rows of m so that the sums do
+    // not depend on the number of threads.
+    std::fill(m.begin(), m.end(), 0.0);
+    utils::parallelFor(0, n_, nthreads, [&](int64_t kb, int64_t ke) {
+      for (int64_t ib = 0; ib < np; ib += OPQ_BLOCK_SIZE) {
+        int64_t ie = std::min(np, ib + OPQ_BLOCK_SIZE);
+        for (int64_t k = kb; k < ke; k++) {
+          double* mk = m.data() + k * n_;
+          for (int64_t i = ib; i < ie; i++) {
+            double xik = xs.at(i, k);
+            const real* yi = ys.data() + i * n_;
+            for (int64_t j = 0; j < n_; j++) {
+              mk[j] += xik * yi[j];
+            }
+          }
+        }
+      }
+    });
+    orthogonalPolar(m, *rotation_, n_);
+  }
+}
+
+void QMatrix::rotate(const Vector& x, Vector& y) const {
+  y.zero();
+  for (int64_t k = 0; k < n_; k++) {
+    const real* rk = rotation_->data() + k * n_;
+    real xk = x[k];
+    for (int64_t j = 0; j < n_; j++) {
+      y[j] += xk * rk[j];
+    }
+  }
+}
+
+// Adds y R^T to x, which maps a vector of the rotated space back.
+void QMatrix::addUnrotated(const Vector& y, Vector& x) const {
+  for (int64_t k = 0; k < n_; k++) {
+    const real* rk = rotation_->data() + k * n_;
+    real sum = 0.0;
+    for (int64_t j = 0; j < n_; j++) {
+      sum += y[j] * rk[j];
+    }
+    x[k] += sum;
   }
-  auto dataptr = temp.data();
-  pq_->train(m_, dataptr);
-  pq_->compute_codes(dataptr, codes_.data(), m_);
 }
 
 void QMatrix::addToVector(Vector& x, int32_t t) const {
@@ -57,9 +328,38 @@ void QMatrix::addToVector(Vector& x, int32_t t) const {
   if (qnorm_) {
     norm = npq_->get_centroids(0, norm_codes_[t])[0];
   }
+  if (rotate_) {
+    Vector y(n_);
+    y.zero();
+    pq_->addcode(y, codes_.data(), t, norm);
+    addUnrotated(y, x);
+    return;
+  }
   pq_->addcode(x, codes_.data(), t, norm);
 }
 
+// Same as calling addToVector on every row, but the sum is accumulated in the
+// rotated space so that it only has to be rotated back once.
+void QMatrix::addRowsToVector(Vector& x,
+                              const std::vector<int32_t>& rows) const {
+  if (!rotate_) {
+    for (auto it = rows.cbegin(); it != rows.cend(); ++it) {
+      addToVector(x, *it);
+    }
+    return;
+  }
+  Vector y(n_);
+  y.zero();
+  for (auto it = rows.cbegin(); it != rows.cend(); ++it) {
+    real norm = 1;
+    if (qnorm_) {
+      norm = npq_->get_centroids(0, norm_codes_[*it])[0];
+    }
+    pq_->addcode(y, codes_.data(), *it, norm);
+  }
+  addUnrotated(y, x);
+}
+
 real QMatrix::dotRow(const Vector& vec, int64_t i) const {
   assert(i >= 0);
   assert(i < m_);
@@ -68,9 +368,51 @@ real QMatrix::dotRow(const Vector& vec, int64_t i) const {
   if (qnorm_) {
     norm = npq_->get_centroids(0, norm_codes_[i])[0];
   }
+  if (rotate_) {
+    Vector rvec(n_);
+    rotate(vec, rvec);
+    return pq_->mulcode(rvec, codes_.data(), i, norm);
+  }
   return pq_->mulcode(vec, codes_.data(), i, norm);
 }
 
+void QMatrix::dotRows(const Vector& vec, Vector& out) const {
+  std::vector<real> table;
+  dotRows(vec, out, table);
+}
+
+// table is scratch space, reusing it across calls avoids allocating the
+// dot-product table for every query.
+void QMatrix::dotRows(const Vector& vec, Vector& out,
+                      std::vector<real>& table) const {
+  assert(vec.size() == n_);
+  assert(out.size() == m_);
+  // The query is rotated once for all the rows.
+  Vector rvec(rotate_ ? n_ : 0);
+  if (rotate_) {
+    rotate(vec, rvec);
+  }
+  const Vector& q = rotate_ ? rvec : vec;
+  if (m_ <= pq_->get_ksub()) {
+    // Building the table costs as much as scoring ksub rows directly.
+    for (int64_t i = 0; i < m_; i++) {
+      real norm = 1;
+      if (qnorm_) {
+        norm = npq_->get_centroids(0, norm_codes_[i])[0];
+      }
+      out[i] = pq_->mulcode(q, codes_.data(), i, norm);
+    }
+    return;
+  }
+  pq_->compute_dot_table(q, table);
+  pq_->mulcodes_table(table.data(), codes_.data(), m_, out.data());
+  if (qnorm_) {
+    for (int64_t i = 0; i < m_; i++) {
+      out[i] *= npq_->get_centroids(0, norm_codes_[i])[0];
+    }
+  }
+}
+
 int64_t QMatrix::getM() const {
   return m_;
 }
@@ -84,29 +426,48 @@ void QMatrix::save(std::ostream& out) {
     out.write((char*) &m_, sizeof(m_));
     out.write((char*) &n_, sizeof(n_));
     out.write((char*) &codesize_, sizeof(codesize_));
+    int32_t nbits = pq_->get_nbits();
+    out.write((char*) &nbits, sizeof(nbits));
     out.write((char*) codes_.data(), codesize_ * sizeof(uint8_t));
     pq_->save(out);
     if (qnorm_) {
       out.write((char*) norm_codes_.data(), m_ * sizeof(uint8_t));
       npq_->save(out);
     }
+    out.write((char*) &rotate_, sizeof(rotate_));
+    if (rotate_) {
+      rotation_->save(out);
+    }
 }
 
-void QMatrix::load(std::istream& in) {
+void QMatrix::load(std::istream& in, int32_t version) {
     in.read((char*) &qnorm_, sizeof(qnorm_));
     in.read((char*) &m_, sizeof(m_));
     in.read((char*) &n_, sizeof(n_));
     in.read((char*) &codesize_, sizeof(codesize_));
+    // Models before version 13 always used 8-bit codes.
+    int32_t nbits = 8;
+    if (version >= 13) {
+      in.read((char*) &nbits, sizeof(nbits));
+    }
     codes_ = std::vector<uint8_t>(codesize_);
     in.read((char*) codes_.data(), codesize_ * sizeof(uint8_t));
     pq_ = std::unique_ptr<ProductQuantizer>( new ProductQuantizer());
-    pq_->load(in);
+    pq_->load(in, nbits);
     if (qnorm_) {
       norm_codes_ = std::vector<uint8_t>(m_);
       in.read((char*) norm_codes_.data(), m_ * sizeof(uint8_t));
       npq_ = std::unique_ptr<ProductQuantizer>( new ProductQuantizer());
       npq_->load(in);
     }
+    rotate_ = false;
+    if (version >= 14) {
+      in.read((char*) &rotate_, sizeof(rotate_));
+    }
+    if (rotate_) {
+      rotation_ = std::unique_ptr<Matrix>( new Matrix());
+      rotation_->load(in);
+    }
 }
 
 }
@@ -32,30 +32,44 @@ class QMatrix {
 
     std::vector<uint8_t> codes_;
     std::vector<uint8_t> norm_codes_;
+    // Orthogonal rotation R applied to the rows before product quantization
+    // (OPQ): row i is stored as codes of w_i R.
+    std::unique_ptr<Matrix> rotation_;
 
     bool qnorm_;
+    bool rotate_;
 
     int64_t m_;
     int64_t n_;
 
     int32_t codesize_;
 
+    void gatherRows(const Matrix&, const Vector&, const int64_t*, int64_t,
+                    real*, int32_t) const;
+    void trainRotation(const Matrix&, int32_t);
+    void rotate(const Vector&, Vector&) const;
+    void addUnrotated(const Vector&, Vector&) const;
+
   public:
 
     QMatrix();
-    QMatrix(const Matrix&, int32_t, bool);
+    QMatrix(const Matrix&, int32_t, bool, int32_t = 8, bool = false,
+            int32_t = 1);
 
     int64_t getM() const;
     int64_t getN() const;
 
-    void quantizeNorm(const Vector&);
-    void quantize(const Matrix&);
+    void quantizeNorm(const Vector&, int32_t = 1);
+    void quantize(const Matrix&, int32_t = 1);
 
     void addToVector(Vector& x, int32_t t) const;
+    void addRowsToVector(Vector& x, const std::vector<int32_t>& rows) const;
     real dotRow(const Vector&, int64_t) const;
+    void dotRows(const Vector&, Vector&) const;
+    void dotRows(const Vector&, Vector&, std::vector<real>&) const;
 
     void save(std::ostream&);
-    void load(std::istream&);
+    void load(std::istream&, int32_t);
 };
 
 }
@@ -9,10 +9,30 @@
 
 #include "utils.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <ios>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace fasttext {
 
+namespace {
+
+// The NumPy type of a native float32.
+std::string npyDescr() {
+  uint16_t one = 1;
+  return *reinterpret_cast<char*>(&one) == 1 ? "<f4" : ">f4";
+}
+
+}
+
 namespace utils {
 
   int64_t size(std::ifstream& ifs) {
@@ -24,6 +44,213 @@ namespace utils {
     ifs.clear();
     ifs.seekg(std::streampos(pos));
   }
+
+  void parallelFor(
+      int64_t begin,
+      int64_t end,
+      int32_t nthreads,
+      const std::function<void(int64_t, int64_t)>& fn) {
+    int64_t n = end - begin;
+    if (n <= 0) {
+      return;
+    }
+    nthreads = std::max<int64_t>(1, std::min<int64_t>(nthreads, n));
+    if (nthreads == 1) {
+      fn(begin, end);
+      return;
+    }
+    std::vector<std::thread> threads;
+    for (int32_t i = 0; i < nthreads; i++) {
+      int64_t b = begin + i * n / nthreads;
+      int64_t e = begin + (i + 1) * n / nthreads;
+      threads.push_back(std::thread([&fn, b, e]() { fn(b, e); }));
+    }
+    for (auto& t : threads) {
+      t.join();
+    }
+  }
+
+  char* formatReal(real x, int32_t precision, char* out) {
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+                                   1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13};
+    static const double negPow10[] = {1e0, 1e-1, 1e-2, 1e-3, 1e-4};
+    double a = std::fabs(double(x));
+    // Only the fixed notation range is handled here; the exponent
+    // notation, zero, infinities and NaN go through snprintf.
+    if (precision < 1 || precision > 9 || !(a >= 1e-4) ||
+        a >= pow10[precision]) {
+      return out + snprintf(out, 32, "%.*g", precision, double(x));
+    }
+    // a = d.ddd * 10^e with precision significant digits. The scaling is
+    // by at most 10^12, so the product of a float and that power is exact
+    // in a double and rounding it matches the correctly rounded printf.
+    int32_t e = -4;
+    while (e + 1 < precision &&
+           a >= (e + 1 < 0 ? negPow10[-(e + 1)] : pow10[e + 1])) {
+      e++;
+    }
+    double digits = std::nearbyint(a * pow10[precision - 1 - e]);
+    if (digits >= pow10[precision]) {
+      e++;
+      if (e >= precision) {
+        return out + snprintf(out, 32, "%.*g", precision, double(x));
+      }
+      digits = std::nearbyint(a * pow10[precision - 1 - e]);
+    }
+    char buf[16];
+    uint64_t d = digits;
+    for (int32_t i = precision - 1; i >= 0; i--) {
+      buf[i] = '0' + d % 10;
+      d /= 10;
+    }
+    // Trailing zeros of the fractional part are dropped, as with %g.
+    int32_t n = precision;
+    while (n > std::max(e + 1, 1) && buf[n - 1] == '0') {
+      n--;
+    }
+    if (std::signbit(x)) {
+      *out++ = '-';
+    }
+    if (e >= 0) {
+      out = std::copy(buf, buf + e + 1, out);
+      if (n > e + 1) {
+        *out++ = '.';
+        out = std::copy(buf + e + 1, buf + n, out);
+      }
+    } else {
+      *out++ = '0';
+      *out++ = '.';
+      out = std::fill_n(out, -e - 1, '0');
+      out = std::copy(buf, buf + n, out);
+    }
+    return out;
+  }
+
+  void writeNpyHeader(std::ostream& out, int64_t rows, int64_t cols) {
+    std::string header = "{'descr': '" + npyDescr() +
+        "', 'fortran_order': False, 'shape': (" + std::to_string(rows) +
+        ", " + std::to_string(cols) + "), }";
+    // Magic, version 1.0, then the header padded with spaces and ended by
+    // a newline so that the data starts on a multiple of 64 bytes.
+    const size_t prefix = 10;
+    size_t total = (prefix + header.size() + 1 + 63) / 64 * 64;
+    header.append(total - prefix - header.size() - 1, ' ');
+    header += '\n';
+    uint16_t size = header.size();
+    out.write("\x93NUMPY\x01\x00", 8);
+    out.put(size & 0xff);
+    out.put(size >> 8);
+    out << header;
+  }
+
+  void readNpyHeader(std::istream& in, int64_t& rows, int64_t& cols) {
+    char magic[8];
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, "\x93NUMPY", 6) != 0 || magic[6] < 1 ||
+        magic[6] > 3) {
+      throw std::invalid_argument("Not a NumPy .npy file!");
+    }
+    unsigned char size[4] = {0, 0, 0, 0};
+    in.read((char*) size, magic[6] == 1 ? 2 : 4);
+    std::string header(
+        size[0] | (size[1] << 8) | (size[2] << 16) | (size[3] << 24), ' ');
+    in.read(&header[0], header.size());
+    size_t shape = header.find("'shape': (");
+    if (!in || header.find("'descr': '" + npyDescr() + "'") ==
+                   std::string::npos ||
+        header.find("'fortran_order': False") == std::string::npos ||
+        shape == std::string::npos) {
+      throw std::invalid_argument(
+          "Only row-major float32 .npy matrices are supported!");
+    }
+    char* end;
+    rows = std::strtoll(header.c_str() + shape + 10, &end, 10);
+    if (*end != ',') {
+      throw std::invalid_argument("Only 2-D .npy matrices are supported!");
+    }
+    cols = std::strtoll(end + 1, &end, 10);
+    if (*end != ')') {
+      throw std::invalid_argument("Only 2-D .npy matrices are supported!");
+    }
+  }
+
+  const char* parseReal(const char* begin, const char* end, real& x) {
+    static const double pow10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    // Fast path for plain decimals: with at most 15 significant digits and
+    // a power of ten of at most 22, the mantissa and the power are exact
+    // doubles and one multiplication or division rounds correctly.
+    const char* p = begin;
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    uint64_t mantissa = 0;
+    int32_t digits = 0;
+    int32_t exponent = 0;
+    bool any = false;
+    bool fast = true;
+    for (bool fraction = false; p < end; p++) {
+      if (*p == '.' && !fraction) {
+        fraction = true;
+        continue;
+      }
+      if (*p < '0' || *p > '9') {
+        break;
+      }
+      any = true;
+      if (mantissa == 0 && *p == '0') {
+        exponent -= fraction;
+        continue;
+      }
+      if (++digits > 15) {
+        fast = false;
+        break;
+      }
+      mantissa = mantissa * 10 + (*p - '0');
+      exponent -= fraction;
+    }
+    if (fast && any && p < end && (*p == 'e' || *p == 'E')) {
+      const char* q = p + 1;
+      bool negativeExponent = q < end && *q == '-';
+      if (q < end && (*q == '-' || *q == '+')) {
+        q++;
+      }
+      int32_t e = 0;
+      for (p = q; p < end && *p >= '0' && *p <= '9' && e < 1000; p++) {
+        e = e * 10 + (*p - '0');
+      }
+      fast = p > q && (p == end || *p < '0' || *p > '9');
+      exponent += negativeExponent ? -e : e;
+    }
+    if (fast && any && (p == end || std::isspace((unsigned char) *p))) {
+      if (mantissa == 0) {
+        x = negative ? -0.0 : 0.0;
+        return p;
+      }
+      if (exponent >= -22 && exponent <= 22) {
+        double d = exponent < 0 ? mantissa / pow10[-exponent]
+                                : mantissa * pow10[exponent];
+        float f = d;
+        // Rounding to a double then to a float is only wrong when the
+        // double falls exactly halfway between two floats.
+        float other = std::nextafter(f, d < f ? -HUGE_VALF : HUGE_VALF);
+        if (d == f || d != (double(f) + double(other)) / 2) {
+          x = negative ? -f : f;
+          return p;
+        }
+      }
+    }
+    const char* token = begin;
+    while (token < end && !std::isspace((unsigned char) *token)) {
+      token++;
+    }
+    std::string copy(begin, token);
+    char* stop;
+    x = std::strtof(copy.c_str(), &stop);
+    return begin + (stop - copy.c_str());
+  }
 }
 
 }
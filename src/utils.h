@@ -9,7 +9,13 @@
 
 #pragma once
 
+#include <cstdint>
 #include <fstream>
+#include <functional>
+#include <istream>
+#include <ostream>
+
+#include "real.h"
 
 #if defined(__clang__) || defined(__GNUC__)
 # define FASTTEXT_DEPRECATED(msg) __attribute__((__deprecated__(msg)))
@@ -25,6 +31,31 @@ namespace utils {
 
   int64_t size(std::ifstream&);
   void seek(std::ifstream&, int64_t);
+
+  // Splits [begin, end) into nthreads contiguous chunks and calls fn(b, e)
+  // on each of them from its own thread. Runs inline when nthreads <= 1.
+  void parallelFor(
+      int64_t begin,
+      int64_t end,
+      int32_t nthreads,
+      const std::function<void(int64_t, int64_t)>& fn);
+
+  // Writes x the way an ostream set to setprecision(precision) does
+  // (printf's %.<precision>g) and returns the end of the characters
+  // written. out needs room for 32 characters.
+  char* formatReal(real x, int32_t precision, char* out);
+
+  // Writes the header of a NumPy .npy file holding a rows x cols float32
+  // matrix in row-major order; the data follows as raw floats.
+  void writeNpyHeader(std::ostream&, int64_t rows, int64_t cols);
+
+  // Reads the header written by writeNpyHeader, leaving the stream at the
+  // start of the data; throws if it does not describe a float32 matrix.
+  void readNpyHeader(std::istream&, int64_t& rows, int64_t& cols);
+
+  // Parses the number at the start of [begin, end) as strtof does and
+  // returns the end of it, or begin if there is none.
+  const char* parseReal(const char* begin, const char* end, real& x);
 }
 
 }
@@ -11,11 +11,11 @@
 
 #include <assert.h>
 
-#include <iomanip>
 #include <cmath>
 
 #include "matrix.h"
 #include "qmatrix.h"
+#include "utils.h"
 
 namespace fasttext {
 
@@ -87,9 +87,7 @@ void Vector::mul(const Matrix& A, const Vector& vec) {
 void Vector::mul(const QMatrix& A, const Vector& vec) {
   assert(A.getM() == size());
   assert(A.getN() == vec.size());
-  for (int64_t i = 0; i < size(); i++) {
-    data_[i] = A.dotRow(vec, i);
-  }
+  A.dotRows(vec, *this);
 }
 
 int64_t Vector::argmax() {
@@ -106,10 +104,17 @@ int64_t Vector::argmax() {
 
 std::ostream& operator<<(std::ostream& os, const Vector& v)
 {
-  os << std::setprecision(5);
+  char buffer[1024];
+  char* end = buffer;
   for (int64_t j = 0; j < v.size(); j++) {
-    os << v[j] << ' ';
+    if (end + 33 > buffer + sizeof(buffer)) {
+      os.write(buffer, end - buffer);
+      end = buffer;
+    }
+    end = utils::formatReal(v[j], 5, end);
+    *end++ = ' ';
   }
+  os.write(buffer, end - buffer);
   return os;
 }
 